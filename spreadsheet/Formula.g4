@@ -9,10 +9,17 @@ expr
     | (ADD | SUB) expr  # UnaryOp
     | expr (MUL | DIV) expr  # BinaryOp
     | expr (ADD | SUB) expr  # BinaryOp
+    | NAME '(' arg (COMMA arg)* ')'  # Call
     | CELL  # Cell
     | NUMBER  # Literal
     ;
 
+// a range is only allowed as a function argument, e.g. SUM(A1:B2,C3)
+arg
+    : CELL COLON CELL  # Range
+    | expr  # Argument
+    ;
+
 // number literals cannot be signed, or else 1-2 would be lexed as [1] [-2]
 fragment INT: [-+]? UINT ;
 fragment UINT: [0-9]+ ;
@@ -27,4 +34,8 @@ SUB: '-' ;
 MUL: '*' ;
 DIV: '/' ;
 CELL: [A-Z]+[0-9]+ ;
+// function names are checked by the parser, see FUNCTION_NAMES
+NAME: [A-Z]+ ;
+COLON: ':' ;
+COMMA: ',' ;
 WS: [ \t\n\r]+ -> skip ;
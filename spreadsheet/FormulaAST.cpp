@@ -1,15 +1,24 @@
 #include "FormulaAST.h"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <cmath>
+#include <exception>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include "FormulaBaseListener.h"
 #include "FormulaLexer.h"
 #include "FormulaParser.h"
+#include "flat_hash_map.h"
+#include "formula.h"
+#include "sheet.h"
+#include "snapshot_format.h"
 
 using std::string;
 
@@ -96,50 +105,578 @@ constexpr PrecedenceRule PRECEDENCE_RULES[EP_END][EP_END] = {
     /* EP_ATOM */ {PR_NONE, PR_NONE, PR_NONE, PR_NONE, PR_NONE, PR_NONE},
 };
 
-ArgCell::ArgCell(const SheetInterface & sheet) : sheet_(sheet) {
+ArgCell::ArgCell(const SheetInterface& sheet, Position origin)
+    : sheet_(sheet)
+    , origin_(origin)
+    , concrete_sheet_(dynamic_cast<const Sheet*>(&sheet)) {
 }
 
-double ASTImpl::ArgCell::operator()(Position pos) const {
+Value ASTImpl::ArgCell::operator()(Position offset) const {
+    const Position pos = Shift(offset, origin_);
     if (!pos.IsValid()) {
-        throw FormulaError(FormulaError::Category::Ref);
+        return FormulaError(FormulaError::Category::Ref);
     }
-        
+
+    if (concrete_sheet_) {
+        const Cell* cell = concrete_sheet_->GetConcreteCell(pos);
+        if (!cell) {
+            return 0.0;
+        }
+        return cell->GetNumericValue();
+    }
+
     const CellInterface* cell = sheet_.GetCell(pos);
+    if (!cell) {
+        return 0.0;
+    }
+
+    const CellInterface::Value value = cell->GetValue();
+    if (const double* number = std::get_if<double>(&value)) {
+        return *number;
+    }
+    if (const std::string* text = std::get_if<std::string>(&value)) {
+        if (text->empty()) {
+            return 0.0;
+        }
+        if (const auto number = ParseNumber(*text)) {
+            return *number;
+        }
+        return FormulaError(FormulaError::Category::Value);
+    }
+    return std::get<FormulaError>(value);
+}
+
+void ArgCell::LoadColumn(Position offset, size_t count, double* numbers, bool* failed, Value* errors) const {
+    const auto load = [&](size_t lane, const Value& value) {
+        if (const double* number = std::get_if<double>(&value)) {
+            numbers[lane] = *number;
+            return;
+        }
+        numbers[lane] = 0;
+        if (!failed[lane]) {
+            failed[lane] = true;
+            errors[lane] = value;
+        }
+    };
 
-    if(!cell || cell->GetText() == "") {
-        return 0;
+    const Position first = Shift(offset, origin_);
+    if (!concrete_sheet_ || !first.IsValid() || !Position{first.row + static_cast<int>(count) - 1, first.col}.IsValid()) {
+        for (size_t lane = 0; lane < count; ++lane) {
+            load(lane, (*this)(Position{offset.row + static_cast<int>(lane), offset.col}));
+        }
+        return;
     }
-    
-    if(std::holds_alternative<double>(cell->GetValue())) {
-        return std::get<double>(cell->GetValue());
+
+    // Cells are looked up a block at a time, their values are already cached
+    const size_t BLOCK_SIZE = 64;
+    const Cell* cells[BLOCK_SIZE];
+    for (size_t begin = 0; begin < count; begin += BLOCK_SIZE) {
+        const size_t size = std::min(BLOCK_SIZE, count - begin);
+        concrete_sheet_->GetColumnCells({first.row + static_cast<int>(begin), first.col}, size, cells);
+        for (size_t i = 0; i < size; ++i) {
+            if (cells[i]) {
+                load(begin + i, cells[i]->GetNumericValue());
+            } else {
+                numbers[begin + i] = 0;
+            }
+        }
     }
+}
 
-    if(std::holds_alternative<std::string>(cell->GetValue())) {
-        auto value = std::get<std::string>(cell->GetValue());
-            double result = 0;
-            if (!value.empty()) {
-                std::istringstream in(value);
-                if (!(in >> result) || !in.eof()) {
-                    throw FormulaError(FormulaError::Category::Value);
+namespace {
+double GetInitialTotal(Function function) {
+    switch (function) {
+        case Function::Min:
+            return INFINITY;
+        case Function::Max:
+            return -INFINITY;
+        default:
+            return 0;
+    }
+}
+
+// Separate loops per function over a block of numbers, min and max ones
+// get vectorized. The sum is kept in order, so SUM(A1:A3) gives exactly
+// what A1+A2+A3 does.
+void Accumulate(Function function, const double* numbers, size_t count, double& total) {
+    switch (function) {
+        case Function::Min:
+            for (size_t i = 0; i < count; ++i) {
+                total = numbers[i] < total ? numbers[i] : total;
+            }
+            break;
+        case Function::Max:
+            for (size_t i = 0; i < count; ++i) {
+                total = numbers[i] > total ? numbers[i] : total;
+            }
+            break;
+        case Function::Count:
+            break;
+        default:
+            for (size_t i = 0; i < count; ++i) {
+                total += numbers[i];
+            }
+            break;
+    }
+}
+}  // namespace
+
+std::optional<FormulaError> ArgCell::LoadRange(Range offsets, Function function, double& total,
+                                               double& count) const {
+    total = GetInitialTotal(function);
+    count = 0;
+
+    const Range range = Shift(offsets, origin_);
+    if (!range.IsValid()) {
+        return FormulaError(FormulaError::Category::Ref);
+    }
+
+    // Sums and counts of ranges without formulas may come from the sheet's
+    // sum index instead of a scan. The index answers only with exact sums,
+    // equal to the in-order one bit for bit.
+    if (concrete_sheet_ && function != Function::Min && function != Function::Max
+        && concrete_sheet_->TrySumRange(range, total, count)) {
+        return std::nullopt;
+    }
+
+    const size_t BLOCK_SIZE = 64;
+    double numbers[BLOCK_SIZE];
+
+    if (!concrete_sheet_) {
+        for (int col = range.first.col; col <= range.last.col; ++col) {
+            for (int row = range.first.row; row <= range.last.row; ++row) {
+                const CellInterface* cell = sheet_.GetCell({row, col});
+                if (!cell) {
+                    continue;
                 }
+                const CellInterface::Value value = cell->GetValue();
+                if (const auto* error = std::get_if<FormulaError>(&value)) {
+                    return *error;
+                }
+                const double* number = std::get_if<double>(&value);
+                const auto parsed = number ? std::optional(*number) : ParseNumber(std::get<std::string>(value));
+                if (parsed) {
+                    Accumulate(function, &*parsed, 1, total);
+                    ++count;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Cells are looked up a block of a column at a time, their numbers are
+    // gathered into a contiguous array and folded into the total together
+    const Cell* cells[BLOCK_SIZE];
+    for (int col = range.first.col; col <= range.last.col; ++col) {
+        for (int row = range.first.row; row <= range.last.row; row += BLOCK_SIZE) {
+            const size_t size = std::min<size_t>(BLOCK_SIZE, range.last.row - row + 1);
+            concrete_sheet_->GetColumnCells({row, col}, size, cells);
+
+            size_t loaded = 0;
+            for (size_t i = 0; i < size; ++i) {
+                if (!cells[i]) {
+                    continue;
+                }
+                const auto value = cells[i]->GetRangeValue();
+                if (!value) {
+                    continue;
+                }
+                if (const double* number = std::get_if<double>(&*value)) {
+                    numbers[loaded++] = *number;
+                } else {
+                    return std::get<FormulaError>(*value);
+                }
+            }
+
+            Accumulate(function, numbers, loaded, total);
+            count += loaded;
+        }
+    }
+    return std::nullopt;
+}
+
+namespace {
+double ApplyOp(OpCode op, double lhs, double rhs) {
+    switch (op) {
+        case OpCode::Add:
+            return lhs + rhs;
+        case OpCode::Subtract:
+            return lhs - rhs;
+        case OpCode::Multiply:
+            return lhs * rhs;
+        case OpCode::Divide:
+            return lhs / rhs;
+        default:
+            assert(false);
+            return 0;
+    }
+}
+}  // namespace
+
+void Program::EmitNumber(double value) {
+    numbers_.push_back(value);
+    Emit(OpCode::PushNumber, static_cast<std::uint32_t>(numbers_.size() - 1), 1);
+}
+
+void Program::EmitCell(Position pos) {
+    cells_.push_back(pos);
+    Emit(OpCode::LoadCell, static_cast<std::uint32_t>(cells_.size() - 1), 1);
+}
+
+void Program::EmitOp(OpCode op) {
+    assert(op == OpCode::Negate);
+    if (!code_.empty() && code_.back().op == OpCode::Negate) {
+        code_.pop_back();
+        return;
+    }
+    if (const auto number = GetNumber(code_.size() - 1)) {
+        numbers_[code_.back().arg] = -*number;
+        return;
+    }
+    Emit(op, 0, 0);
+}
+
+void Program::EmitOp(OpCode op, size_t rhs_begin) {
+    // An operand is a single instruction only when it is a number, so the
+    // instructions just before rhs_begin and at the end hold the operands
+    const auto lhs = GetNumber(rhs_begin - 1);
+    const auto rhs = GetNumber(code_.size() - 1);
+
+    if (lhs && rhs) {
+        const double result = ApplyOp(op, *lhs, *rhs);
+        if (std::isfinite(result)) {
+            PopNumber();
+            PopNumber();
+            EmitNumber(result);
+            return;
+        }
+    } else if (rhs && (op == OpCode::Multiply || op == OpCode::Divide) && std::abs(*rhs) == 1) {
+        PopNumber();
+        if (*rhs < 0) {
+            EmitOp(OpCode::Negate);
+        }
+        return;
+    } else if (rhs && op == OpCode::Subtract && *rhs == 0 && !std::signbit(*rhs)) {
+        PopNumber();
+        return;
+    } else if (lhs && op == OpCode::Multiply && std::abs(*lhs) == 1) {
+        // The left number stays in the pool unused
+        code_.erase(code_.begin() + (rhs_begin - 1));
+        --stack_depth_;
+        if (*lhs < 0) {
+            EmitOp(OpCode::Negate);
+        }
+        return;
+    }
+
+    Emit(op, 0, -1);
+}
+
+void Program::EmitRange(Range offsets, Function function) {
+    ranges_.push_back({offsets, function});
+    Emit(OpCode::LoadRange, static_cast<std::uint32_t>(ranges_.size() - 1), 2);
+}
+
+void Program::EmitCall(Function function, size_t arg_count) {
+    calls_.push_back({function, static_cast<std::uint32_t>(arg_count)});
+    Emit(OpCode::Aggregate, static_cast<std::uint32_t>(calls_.size() - 1), 1 - 2 * static_cast<int>(arg_count));
+}
+
+size_t Program::GetCodeSize() const {
+    return code_.size();
+}
+
+std::optional<double> Program::GetNumber(size_t index) const {
+    if (index < code_.size() && code_[index].op == OpCode::PushNumber) {
+        return numbers_[code_[index].arg];
+    }
+    return std::nullopt;
+}
+
+void Program::PopNumber() {
+    assert(code_.back().op == OpCode::PushNumber && code_.back().arg == numbers_.size() - 1);
+    code_.pop_back();
+    numbers_.pop_back();
+    --stack_depth_;
+}
+
+void Program::Emit(OpCode op, std::uint32_t arg, int stack_effect) {
+    code_.push_back({op, arg});
+    stack_depth_ += stack_effect;
+    max_stack_depth_ = std::max(max_stack_depth_, stack_depth_);
+}
+
+namespace {
+// Combines the partial results of function arguments. The partial result of
+// argument i is at slots[2 * i * stride], its count at slots[(2 * i + 1) * stride].
+Value CombineArguments(Function function, const double* slots, size_t arg_count, size_t stride) {
+    double total = slots[0];
+    double count = slots[stride];
+    for (size_t i = 1; i < arg_count; ++i) {
+        const double value = slots[2 * i * stride];
+        count += slots[(2 * i + 1) * stride];
+        switch (function) {
+            case Function::Min:
+                total = std::min(total, value);
+                break;
+            case Function::Max:
+                total = std::max(total, value);
+                break;
+            default:
+                total += value;
+                break;
+        }
+    }
+
+    switch (function) {
+        case Function::Average:
+            if (count == 0) {
+                return FormulaError(FormulaError::Category::Arithmetic);
+            }
+            total /= count;
+            break;
+        case Function::Min:
+        case Function::Max:
+            // Nothing to compare gives zero
+            if (count == 0) {
+                total = 0;
             }
-            return result;
+            break;
+        case Function::Count:
+            total = count;
+            break;
+        default:
+            break;
     }
 
-    throw FormulaError(std::get<FormulaError>(cell->GetValue()));
+    if (!std::isfinite(total)) {
+        return FormulaError(FormulaError::Category::Arithmetic);
+    }
+    return total;
+}
+}  // namespace
+
+Value Program::Execute(const ArgCell& args) const {
+    double inline_stack[INLINE_STACK_SIZE];
+    std::vector<double> heap_stack;
+
+    double* stack = inline_stack;
+    if (max_stack_depth_ > INLINE_STACK_SIZE) {
+        heap_stack.resize(max_stack_depth_);
+        stack = heap_stack.data();
+    }
+
+    // top points past the last value on the stack
+    double* top = stack;
+    for (const Instruction& instruction : code_) {
+        switch (instruction.op) {
+            case OpCode::PushNumber:
+                *top++ = numbers_[instruction.arg];
+                continue;
+            case OpCode::LoadCell: {
+                const Value value = args(cells_[instruction.arg]);
+                if (const double* number = std::get_if<double>(&value)) {
+                    *top++ = *number;
+                    continue;
+                }
+                return value;
+            }
+            case OpCode::Add:
+                --top;
+                top[-1] += *top;
+                break;
+            case OpCode::Subtract:
+                --top;
+                top[-1] -= *top;
+                break;
+            case OpCode::Multiply:
+                --top;
+                top[-1] *= *top;
+                break;
+            case OpCode::Divide:
+                --top;
+                top[-1] /= *top;
+                break;
+            case OpCode::Negate:
+                top[-1] = -top[-1];
+                continue;
+            case OpCode::LoadRange: {
+                const RangeArg& range = ranges_[instruction.arg];
+                if (const auto error = args.LoadRange(range.offsets, range.function, top[0], top[1])) {
+                    return *error;
+                }
+                top += 2;
+                continue;
+            }
+            case OpCode::Aggregate: {
+                const Call& call = calls_[instruction.arg];
+                top -= 2 * call.arg_count;
+                const Value value = CombineArguments(call.function, top, call.arg_count, 1);
+                if (const double* number = std::get_if<double>(&value)) {
+                    *top++ = *number;
+                    continue;
+                }
+                return value;
+            }
+        }
+
+        // Only binary operations get here
+        if (!std::isfinite(top[-1])) {
+            return FormulaError(FormulaError::Category::Arithmetic);
+        }
+    }
+
+    assert(top == stack + 1);
+    return *stack;
+}
+
+void Program::ExecuteColumn(const ArgCell& args, size_t count, Value* results) const {
+    // Every stack slot holds a whole column. A lane that hit an error keeps
+    // computing on zeros, only its first error is reported.
+    std::vector<double> stack(max_stack_depth_ * count);
+    std::unique_ptr<bool[]> failed(new bool[count]());
+
+    double* top = stack.data();
+    for (const Instruction& instruction : code_) {
+        switch (instruction.op) {
+            case OpCode::PushNumber:
+                std::fill(top, top + count, numbers_[instruction.arg]);
+                top += count;
+                continue;
+            case OpCode::LoadCell:
+                args.LoadColumn(cells_[instruction.arg], count, top, failed.get(), results);
+                top += count;
+                continue;
+            case OpCode::Negate:
+                for (double* value = top - count; value < top; ++value) {
+                    *value = -*value;
+                }
+                continue;
+            case OpCode::LoadRange: {
+                const RangeArg& range = ranges_[instruction.arg];
+                for (size_t lane = 0; lane < count; ++lane) {
+                    const int shift = static_cast<int>(lane);
+                    const Range offsets{{range.offsets.first.row + shift, range.offsets.first.col},
+                                        {range.offsets.last.row + shift, range.offsets.last.col}};
+                    const auto error = args.LoadRange(offsets, range.function, top[lane], top[count + lane]);
+                    if (error) {
+                        top[lane] = top[count + lane] = 0;
+                        if (!failed[lane]) {
+                            failed[lane] = true;
+                            results[lane] = *error;
+                        }
+                    }
+                }
+                top += 2 * count;
+                continue;
+            }
+            case OpCode::Aggregate: {
+                const Call& call = calls_[instruction.arg];
+                top -= 2 * call.arg_count * count;
+                for (size_t lane = 0; lane < count; ++lane) {
+                    const Value value = CombineArguments(call.function, top + lane, call.arg_count, count);
+                    if (const double* number = std::get_if<double>(&value)) {
+                        top[lane] = *number;
+                        continue;
+                    }
+                    top[lane] = 0;
+                    if (!failed[lane]) {
+                        failed[lane] = true;
+                        results[lane] = value;
+                    }
+                }
+                top += count;
+                continue;
+            }
+            default:
+                break;
+        }
+
+        top -= count;
+        double* lhs = top - count;
+        const double* rhs = top;
+        switch (instruction.op) {
+            case OpCode::Add:
+                for (size_t i = 0; i < count; ++i) {
+                    lhs[i] += rhs[i];
+                }
+                break;
+            case OpCode::Subtract:
+                for (size_t i = 0; i < count; ++i) {
+                    lhs[i] -= rhs[i];
+                }
+                break;
+            case OpCode::Multiply:
+                for (size_t i = 0; i < count; ++i) {
+                    lhs[i] *= rhs[i];
+                }
+                break;
+            case OpCode::Divide:
+                for (size_t i = 0; i < count; ++i) {
+                    lhs[i] /= rhs[i];
+                }
+                break;
+            default:
+                assert(false);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!std::isfinite(lhs[i]) && !failed[i]) {
+                failed[i] = true;
+                results[i] = FormulaError(FormulaError::Category::Arithmetic);
+            }
+        }
+    }
+
+    assert(top == stack.data() + count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!failed[i]) {
+            results[i] = stack[i];
+        }
+    }
+}
+
+// Node tags of the serialized postfix form; binary operators are stored as
+// their own characters
+enum SerializedTag : std::uint8_t {
+    ST_NUMBER = 'n',
+    ST_CELL = 'c',
+    ST_UNARY_PLUS = 'p',
+    ST_UNARY_MINUS = 'm',
+    ST_RANGE = 'r',
+    ST_FUNCTION = 'f',
+};
+
+constexpr std::string_view FUNCTION_NAMES[] = {"SUM", "AVERAGE", "MIN", "MAX", "COUNT"};
+
+std::optional<Function> FindFunction(std::string_view name) {
+    for (size_t i = 0; i < std::size(FUNCTION_NAMES); ++i) {
+        if (FUNCTION_NAMES[i] == name) {
+            return static_cast<Function>(i);
+        }
+    }
+    return std::nullopt;
 }
 
 class Expr {
 public:
     virtual ~Expr() = default;
     virtual void Print(std::ostream& out) const = 0;
-    virtual void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const = 0;
-    virtual double Evaluate(const ArgCell& args) const = 0;
+    virtual void DoPrintFormula(std::ostream& out, ExprPrecedence precedence, Position origin) const = 0;
+    virtual void Compile(Program& program) const = 0;
+    // Without origin cell references are written as raw offsets, which is
+    // only used to compare trees
+    virtual void Serialize(snapshot::Writer& out, std::optional<Position> origin) const = 0;
 
     // higher is tighter
     virtual ExprPrecedence GetPrecedence() const = 0;
 
-    void PrintFormula(std::ostream& out, ExprPrecedence parent_precedence,
+    // A range can only be a function argument, the function compiles it
+    virtual const Range* GetRange() const {
+        return nullptr;
+    }
+
+    void PrintFormula(std::ostream& out, ExprPrecedence parent_precedence, Position origin,
                       bool right_child = false) const {
         auto precedence = GetPrecedence();
         auto mask = right_child ? PR_RIGHT : PR_LEFT;
@@ -148,7 +685,7 @@ public:
             out << '(';
         }
 
-        DoPrintFormula(out, precedence);
+        DoPrintFormula(out, precedence, origin);
 
         if (parens_needed) {
             out << ')';
@@ -181,10 +718,10 @@ public:
         out << ')';
     }
 
-    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const override {
-        lhs_->PrintFormula(out, precedence);
+    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence, Position origin) const override {
+        lhs_->PrintFormula(out, precedence, origin);
         out << static_cast<char>(type_);
-        rhs_->PrintFormula(out, precedence, /* right_child = */ true);
+        rhs_->PrintFormula(out, precedence, origin, /* right_child = */ true);
     }
 
     ExprPrecedence GetPrecedence() const override {
@@ -204,27 +741,30 @@ public:
         }
     }
 
-    double Evaluate(const ArgCell& args) const override {
-        double result = 0.0;
+    void Serialize(snapshot::Writer& out, std::optional<Position> origin) const override {
+        lhs_->Serialize(out, origin);
+        rhs_->Serialize(out, origin);
+        out.PutU8(static_cast<std::uint8_t>(type_));
+    }
+
+    void Compile(Program& program) const override {
+        lhs_->Compile(program);
+        const size_t rhs_begin = program.GetCodeSize();
+        rhs_->Compile(program);
         switch (type_) {
             case Add:
-                result = lhs_->Evaluate(args) + rhs_->Evaluate(args);
+                program.EmitOp(OpCode::Add, rhs_begin);
                 break;
             case Subtract:
-                result = lhs_->Evaluate(args) - rhs_->Evaluate(args);
+                program.EmitOp(OpCode::Subtract, rhs_begin);
                 break;
             case Multiply:
-                result = lhs_->Evaluate(args) * rhs_->Evaluate(args);
+                program.EmitOp(OpCode::Multiply, rhs_begin);
                 break;
             case Divide:
-                result = lhs_->Evaluate(args) / rhs_->Evaluate(args);
+                program.EmitOp(OpCode::Divide, rhs_begin);
                 break;
-            }
-        if (!std::isfinite(result)){
-            throw FormulaError{ FormulaError::Category::Arithmetic};
         }
-
-        return result;
     }
 
 private:
@@ -252,20 +792,24 @@ public:
         out << ')';
     }
 
-    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const override {
+    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence, Position origin) const override {
         out << static_cast<char>(type_);
-        operand_->PrintFormula(out, precedence);
+        operand_->PrintFormula(out, precedence, origin);
     }
 
     ExprPrecedence GetPrecedence() const override {
         return EP_UNARY;
     }
 
-    double Evaluate(const ArgCell& args) const override {
-        if(type_ == UnaryMinus) {
-            return -(operand_->Evaluate(args));
-        } else {
-            return operand_->Evaluate(args);
+    void Serialize(snapshot::Writer& out, std::optional<Position> origin) const override {
+        operand_->Serialize(out, origin);
+        out.PutU8(type_ == UnaryMinus ? ST_UNARY_MINUS : ST_UNARY_PLUS);
+    }
+
+    void Compile(Program& program) const override {
+        operand_->Compile(program);
+        if (type_ == UnaryMinus) {
+            program.EmitOp(OpCode::Negate);
         }
     }
 
@@ -281,27 +825,154 @@ public:
     }
 
     void Print(std::ostream& out) const override {
-        if (!cell_->IsValid()) {
+        PrintCell(out, *cell_);
+    }
+
+    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */, Position origin) const override {
+        PrintCell(out, Shift(*cell_, origin));
+    }
+
+    ExprPrecedence GetPrecedence() const override {
+        return EP_ATOM;
+    }
+
+    void Serialize(snapshot::Writer& out, std::optional<Position> origin) const override {
+        out.PutU8(ST_CELL);
+        if (origin) {
+            out.PutU32(PackPosition(Shift(*cell_, *origin)));
+        } else {
+            out.PutU32(static_cast<std::uint32_t>(cell_->row));
+            out.PutU32(static_cast<std::uint32_t>(cell_->col));
+        }
+    }
+
+    void Compile(Program& program) const override {
+        program.EmitCell(*cell_);
+    }
+
+private:
+    const Position* cell_;
+
+    static void PrintCell(std::ostream& out, Position pos) {
+        if (!pos.IsValid()) {
             out << FormulaError::Category::Ref;
         } else {
-            out << cell_->ToString();
+            out << pos.ToString();
         }
     }
+};
+
+class RangeExpr final : public Expr {
+public:
+    explicit RangeExpr(const Range* range)
+        : range_(range) {
+    }
+
+    void Print(std::ostream& out) const override {
+        PrintRange(out, *range_);
+    }
 
-    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */) const override {
-        Print(out);
+    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */, Position origin) const override {
+        PrintRange(out, Shift(*range_, origin));
     }
 
     ExprPrecedence GetPrecedence() const override {
         return EP_ATOM;
     }
 
-    double Evaluate(const ArgCell& args) const override {
-        return args(*cell_);
+    const Range* GetRange() const override {
+        return range_;
+    }
+
+    void Serialize(snapshot::Writer& out, std::optional<Position> origin) const override {
+        out.PutU8(ST_RANGE);
+        if (origin) {
+            const Range range = Shift(*range_, *origin);
+            out.PutU32(PackPosition(range.first));
+            out.PutU32(PackPosition(range.last));
+        } else {
+            for (Position pos : {range_->first, range_->last}) {
+                out.PutU32(static_cast<std::uint32_t>(pos.row));
+                out.PutU32(static_cast<std::uint32_t>(pos.col));
+            }
+        }
+    }
+
+    void Compile(Program& /* program */) const override {
+        assert(false);
     }
 
 private:
-    const Position* cell_;
+    const Range* range_;
+
+    static void PrintRange(std::ostream& out, Range range) {
+        if (!range.IsValid()) {
+            out << FormulaError::Category::Ref;
+        } else {
+            out << range.ToString();
+        }
+    }
+};
+
+class FunctionExpr final : public Expr {
+public:
+    FunctionExpr(Function function, std::vector<std::unique_ptr<Expr>> args)
+        : function_(function)
+        , args_(std::move(args)) {
+        assert(!args_.empty());
+    }
+
+    void Print(std::ostream& out) const override {
+        out << '(' << FUNCTION_NAMES[static_cast<size_t>(function_)];
+        for (const auto& arg : args_) {
+            out << ' ';
+            arg->Print(out);
+        }
+        out << ')';
+    }
+
+    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */, Position origin) const override {
+        out << FUNCTION_NAMES[static_cast<size_t>(function_)] << '(';
+        bool first = true;
+        for (const auto& arg : args_) {
+            if (!first) {
+                out << ',';
+            }
+            first = false;
+            arg->PrintFormula(out, EP_ATOM, origin);
+        }
+        out << ')';
+    }
+
+    ExprPrecedence GetPrecedence() const override {
+        return EP_ATOM;
+    }
+
+    void Serialize(snapshot::Writer& out, std::optional<Position> origin) const override {
+        for (const auto& arg : args_) {
+            arg->Serialize(out, origin);
+        }
+        out.PutU8(ST_FUNCTION);
+        out.PutU8(static_cast<std::uint8_t>(function_));
+        out.PutU32(static_cast<std::uint32_t>(args_.size()));
+    }
+
+    void Compile(Program& program) const override {
+        for (const auto& arg : args_) {
+            if (const Range* range = arg->GetRange()) {
+                program.EmitRange(*range, function_);
+            } else {
+                arg->Compile(program);
+                // a value counts as one number
+                program.EmitNumber(1);
+            }
+        }
+        program.EmitCall(function_, args_.size());
+    }
+
+private:
+    Function function_;
+    std::vector<std::unique_ptr<Expr>> args_;
 };
 
 class NumberExpr final : public Expr {
@@ -314,7 +985,7 @@ public:
         out << value_;
     }
 
-    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */) const override {
+    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */, Position /* origin */) const override {
         out << value_;
     }
 
@@ -322,14 +993,25 @@ public:
         return EP_ATOM;
     }
 
-    double Evaluate(const ArgCell& args) const override {
-        return value_;
+    void Serialize(snapshot::Writer& out, std::optional<Position> /* origin */) const override {
+        out.PutU8(ST_NUMBER);
+        out.PutDouble(value_);
+    }
+
+    void Compile(Program& program) const override {
+        program.EmitNumber(value_);
     }
 
 private:
     double value_;
 };
 
+// Any two opposite corners give the same range
+Range MakeRange(Position first, Position last) {
+    return {{std::min(first.row, last.row), std::min(first.col, last.col)},
+            {std::max(first.row, last.row), std::max(first.col, last.col)}};
+}
+
 class ParseASTListener final : public FormulaBaseListener {
 public:
     std::unique_ptr<Expr> MoveRoot() {
@@ -344,6 +1026,10 @@ public:
         return std::move(cells_);
     }
 
+    std::forward_list<Range> MoveRanges() {
+        return std::move(ranges_);
+    }
+
 public:
     void exitUnaryOp(FormulaParser::UnaryOpContext* ctx) override {
         assert(args_.size() >= 1);
@@ -411,6 +1097,38 @@ public:
         args_.back() = std::move(node);
     }
 
+    void exitRange(FormulaParser::RangeContext* ctx) override {
+        Position corners[2];
+        for (size_t i = 0; i < 2; ++i) {
+            auto value_str = ctx->CELL(i)->getSymbol()->getText();
+            corners[i] = Position::FromString(value_str);
+            if (!corners[i].IsValid()) {
+                throw FormulaException("Invalid position: " + value_str);
+            }
+        }
+
+        ranges_.push_front(MakeRange(corners[0], corners[1]));
+        auto node = std::make_unique<RangeExpr>(&ranges_.front());
+        args_.push_back(std::move(node));
+    }
+
+    void exitCall(FormulaParser::CallContext* ctx) override {
+        // unknown names are rejected before the walk, see ParseFormulaASTAntlr
+        const auto function = FindFunction(ctx->NAME()->getSymbol()->getText());
+        assert(function);
+
+        const size_t arg_count = ctx->arg().size();
+        assert(args_.size() >= arg_count);
+
+        const auto first_arg = args_.end() - static_cast<std::ptrdiff_t>(arg_count);
+        std::vector<std::unique_ptr<Expr>> args(std::make_move_iterator(first_arg),
+                                                std::make_move_iterator(args_.end()));
+        args_.erase(first_arg, args_.end());
+
+        auto node = std::make_unique<FunctionExpr>(*function, std::move(args));
+        args_.push_back(std::move(node));
+    }
+
     void visitErrorNode(antlr4::tree::ErrorNode* node) override {
         throw ParsingError("Error when parsing: " + node->getSymbol()->getText());
     }
@@ -418,6 +1136,7 @@ public:
 private:
     std::vector<std::unique_ptr<Expr>> args_;
     std::forward_list<Position> cells_;
+    std::forward_list<Range> ranges_;
 };
 
 class BailErrorListener : public antlr4::BaseErrorListener {
@@ -429,10 +1148,356 @@ public:
         throw ParsingError("Error when lexing: " + msg);
     }
 };
+
+// Hand-written lexer and precedence-climbing parser for the Formula.g4
+// grammar. Builds the same AST as ParseASTListener without the ANTLR token
+// stream and parse tree. Errors are reported the way the ANTLR pipeline
+// reports them: malformed input and unknown function names fail with
+// ParsingError before any semantic check, then literals, cells and ranges
+// are validated left to right.
+class DirectParser {
+public:
+    explicit DirectParser(std::string_view input)
+        : input_(input) {
+    }
+
+    FormulaAST Parse() {
+        Advance();
+        auto root = ParseExpr(0);
+        if (token_.type != TokenType::End) {
+            throw ParsingError("Error when parsing: unexpected " + std::string(token_.text));
+        }
+
+        if (semantic_error_) {
+            std::rethrow_exception(semantic_error_);
+        }
+
+        return FormulaAST(std::move(root), std::move(cells_), std::move(ranges_));
+    }
+
+private:
+    enum class TokenType {
+        Number,
+        Cell,
+        Name,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        LeftParen,
+        RightParen,
+        Colon,
+        Comma,
+        End,
+    };
+
+    struct Token {
+        TokenType type = TokenType::End;
+        std::string_view text;
+    };
+
+    std::string_view input_;
+    size_t offset_ = 0;
+    Token token_;
+    std::forward_list<Position> cells_;
+    std::forward_list<Range> ranges_;
+    // the first literal or cell error in source order, the same one the
+    // listener would have thrown while walking the tree
+    std::exception_ptr semantic_error_;
+
+    static bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool IsUpper(char c) {
+        return c >= 'A' && c <= 'Z';
+    }
+
+    bool DigitAt(size_t offset) const {
+        return offset < input_.size() && IsDigit(input_[offset]);
+    }
+
+    size_t SkipDigits(size_t offset) const {
+        while (DigitAt(offset)) {
+            ++offset;
+        }
+        return offset;
+    }
+
+    // NUMBER: UINT EXPONENT? | UINT? '.' UINT EXPONENT?
+    size_t MatchNumber(size_t begin) const {
+        size_t end = SkipDigits(begin);
+        if (end < input_.size() && input_[end] == '.' && DigitAt(end + 1)) {
+            end = SkipDigits(end + 1);
+        } else if (end == begin) {
+            return begin;
+        }
+
+        if (end < input_.size() && (input_[end] == 'e' || input_[end] == 'E')) {
+            size_t exponent = end + 1;
+            if (exponent < input_.size() && (input_[exponent] == '+' || input_[exponent] == '-')) {
+                ++exponent;
+            }
+            if (DigitAt(exponent)) {
+                end = SkipDigits(exponent);
+            }
+        }
+
+        return end;
+    }
+
+    // CELL: [A-Z]+[0-9]+
+    size_t MatchCell(size_t begin) const {
+        size_t end = begin;
+        while (end < input_.size() && IsUpper(input_[end])) {
+            ++end;
+        }
+        if (end == begin || !DigitAt(end)) {
+            return begin;
+        }
+
+        return SkipDigits(end);
+    }
+
+    // NAME: [A-Z]+ not followed by a digit, which would make it a CELL
+    size_t MatchName(size_t begin) const {
+        size_t end = begin;
+        while (end < input_.size() && IsUpper(input_[end])) {
+            ++end;
+        }
+        return end;
+    }
+
+    size_t SkipSpaces(size_t offset) const {
+        while (offset < input_.size()
+               && (input_[offset] == ' ' || input_[offset] == '\t'
+                   || input_[offset] == '\n' || input_[offset] == '\r')) {
+            ++offset;
+        }
+        return offset;
+    }
+
+    void Advance() {
+        offset_ = SkipSpaces(offset_);
+
+        if (offset_ == input_.size()) {
+            token_ = {TokenType::End, "<EOF>"};
+            return;
+        }
+
+        const size_t begin = offset_;
+        TokenType type = TokenType::End;
+        switch (input_[begin]) {
+            case '+':
+                type = TokenType::Add;
+                break;
+            case '-':
+                type = TokenType::Sub;
+                break;
+            case '*':
+                type = TokenType::Mul;
+                break;
+            case '/':
+                type = TokenType::Div;
+                break;
+            case '(':
+                type = TokenType::LeftParen;
+                break;
+            case ')':
+                type = TokenType::RightParen;
+                break;
+            case ':':
+                type = TokenType::Colon;
+                break;
+            case ',':
+                type = TokenType::Comma;
+                break;
+            default:
+                break;
+        }
+
+        if (type != TokenType::End) {
+            offset_ = begin + 1;
+        } else if (size_t end = MatchNumber(begin); end != begin) {
+            type = TokenType::Number;
+            offset_ = end;
+        } else if (size_t end = MatchCell(begin); end != begin) {
+            type = TokenType::Cell;
+            offset_ = end;
+        } else if (size_t end = MatchName(begin); end != begin) {
+            type = TokenType::Name;
+            offset_ = end;
+        } else {
+            throw ParsingError("Error when lexing: token recognition error at: '"
+                               + std::string(input_.substr(begin, 1)) + "'");
+        }
+
+        token_ = {type, input_.substr(begin, offset_ - begin)};
+    }
+
+    static int BinaryPrecedence(TokenType type) {
+        switch (type) {
+            case TokenType::Add:
+            case TokenType::Sub:
+                return 1;
+            case TokenType::Mul:
+            case TokenType::Div:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    std::unique_ptr<Expr> ParseExpr(int min_precedence) {
+        auto lhs = ParsePrefix();
+
+        // all binary operators are left-associative
+        for (int precedence = BinaryPrecedence(token_.type);
+             precedence > min_precedence; precedence = BinaryPrecedence(token_.type)) {
+            BinaryOpExpr::Type type = BinaryOpExpr::Add;
+            switch (token_.type) {
+                case TokenType::Sub:
+                    type = BinaryOpExpr::Subtract;
+                    break;
+                case TokenType::Mul:
+                    type = BinaryOpExpr::Multiply;
+                    break;
+                case TokenType::Div:
+                    type = BinaryOpExpr::Divide;
+                    break;
+                default:
+                    break;
+            }
+
+            Advance();
+            auto rhs = ParseExpr(precedence);
+            lhs = std::make_unique<BinaryOpExpr>(type, std::move(lhs), std::move(rhs));
+        }
+
+        return lhs;
+    }
+
+    // A unary operator binds tighter than any binary one, so its operand is
+    // again a prefix expression: -A1*B1 is (-A1)*B1.
+    std::unique_ptr<Expr> ParsePrefix() {
+        const Token token = token_;
+        switch (token.type) {
+            case TokenType::Add:
+            case TokenType::Sub: {
+                Advance();
+                auto operand = ParsePrefix();
+                return std::make_unique<UnaryOpExpr>(
+                    token.type == TokenType::Sub ? UnaryOpExpr::UnaryMinus : UnaryOpExpr::UnaryPlus,
+                    std::move(operand));
+            }
+            case TokenType::LeftParen: {
+                Advance();
+                auto expr = ParseExpr(0);
+                if (token_.type != TokenType::RightParen) {
+                    throw ParsingError("Error when parsing: expected ')' at " + std::string(token_.text));
+                }
+                Advance();
+                return expr;
+            }
+            case TokenType::Number:
+                Advance();
+                return std::make_unique<NumberExpr>(ParseNumber(token.text));
+            case TokenType::Cell: {
+                Advance();
+                const auto value = Position::FromString(token.text);
+                if (!value.IsValid()) {
+                    SetSemanticError(FormulaException("Invalid position: " + std::string(token.text)));
+                }
+
+                cells_.push_front(value);
+                return std::make_unique<CellExpr>(&cells_.front());
+            }
+            case TokenType::Name:
+                Advance();
+                return ParseCall(token.text);
+            default:
+                throw ParsingError("Error when parsing: unexpected " + std::string(token.text));
+        }
+    }
+
+    std::unique_ptr<Expr> ParseCall(std::string_view name) {
+        const auto function = FindFunction(name);
+        if (!function) {
+            throw ParsingError("Error when parsing: unknown function " + std::string(name));
+        }
+        if (token_.type != TokenType::LeftParen) {
+            throw ParsingError("Error when parsing: expected '(' at " + std::string(token_.text));
+        }
+
+        std::vector<std::unique_ptr<Expr>> args;
+        do {
+            Advance();
+            args.push_back(ParseArgument());
+        } while (token_.type == TokenType::Comma);
+
+        if (token_.type != TokenType::RightParen) {
+            throw ParsingError("Error when parsing: expected ')' at " + std::string(token_.text));
+        }
+        Advance();
+        return std::make_unique<FunctionExpr>(*function, std::move(args));
+    }
+
+    std::unique_ptr<Expr> ParseArgument() {
+        // A cell followed by ':' starts a range rather than an expression
+        const size_t next = SkipSpaces(offset_);
+        if (token_.type != TokenType::Cell || next == input_.size() || input_[next] != ':') {
+            return ParseExpr(0);
+        }
+
+        const Token first = token_;
+        Advance();
+        Advance();
+        if (token_.type != TokenType::Cell) {
+            throw ParsingError("Error when parsing: expected a cell at " + std::string(token_.text));
+        }
+        const Token last = token_;
+        Advance();
+
+        const Position first_pos = Position::FromString(first.text);
+        const Position last_pos = Position::FromString(last.text);
+        for (const auto& [pos, text] : {std::pair(first_pos, first.text), std::pair(last_pos, last.text)}) {
+            if (!pos.IsValid()) {
+                SetSemanticError(FormulaException("Invalid position: " + std::string(text)));
+            }
+        }
+
+        ranges_.push_front(MakeRange(first_pos, last_pos));
+        return std::make_unique<RangeExpr>(&ranges_.front());
+    }
+
+    double ParseNumber(std::string_view text) {
+        double value = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error == std::errc() && end == text.data() + text.size()) {
+            return value;
+        }
+
+        // out of range literals are rare, let iostreams decide on them
+        // exactly as the listener does
+        std::istringstream in{std::string(text)};
+        in >> value;
+        if (!in) {
+            SetSemanticError(ParsingError("Invalid number: " + std::string(text)));
+        }
+        return value;
+    }
+
+    template <typename Error>
+    void SetSemanticError(Error error) {
+        if (!semantic_error_) {
+            semantic_error_ = std::make_exception_ptr(std::move(error));
+        }
+    }
+};
 } // namespace
 }  // namespace ASTImpl
 
-FormulaAST ParseFormulaAST(std::istream& in) {
+FormulaAST ParseFormulaASTAntlr(std::istream& in) {
     using namespace antlr4;
 
     ANTLRInputStream input(in);
@@ -450,15 +1515,129 @@ FormulaAST ParseFormulaAST(std::istream& in) {
     parser.removeErrorListeners();
 
     tree::ParseTree* tree = parser.main();
+
+    // The grammar accepts any NAME, an unknown function is still a syntax
+    // error and so must win over the semantic errors found by the walk
+    for (const Token* token : tokens.getTokens()) {
+        if (token->getType() == FormulaLexer::NAME && !ASTImpl::FindFunction(token->getText())) {
+            throw ParsingError("Error when parsing: unknown function " + token->getText());
+        }
+    }
+
     ASTImpl::ParseASTListener listener;
     tree::ParseTreeWalker::DEFAULT.walk(&listener, tree);
 
-    return FormulaAST(listener.MoveRoot(), listener.MoveCells());
+    return FormulaAST(listener.MoveRoot(), listener.MoveCells(), listener.MoveRanges());
 }
 
-FormulaAST ParseFormulaAST(const std::string& in_str) {
+FormulaAST ParseFormulaASTAntlr(const std::string& in_str) {
     std::istringstream in(in_str);
-    return ParseFormulaAST(in);
+    return ParseFormulaASTAntlr(in);
+}
+
+FormulaAST DeserializeFormulaAST(std::string_view data) {
+    using namespace ASTImpl;
+
+    snapshot::Reader in(data);
+    std::vector<std::unique_ptr<Expr>> args;
+    std::forward_list<Position> cells;
+    std::forward_list<Range> ranges;
+
+    const auto pop_arg = [&args]() {
+        if (args.empty()) {
+            throw SnapshotException("Formula operator without operands");
+        }
+        auto arg = std::move(args.back());
+        args.pop_back();
+        return arg;
+    };
+    const auto pop = [&pop_arg]() {
+        auto arg = pop_arg();
+        if (arg->GetRange()) {
+            throw SnapshotException("Range outside of a function call");
+        }
+        return arg;
+    };
+
+    while (!in.AtEnd()) {
+        const std::uint8_t tag = in.GetU8();
+        switch (tag) {
+            case ST_NUMBER:
+                args.push_back(std::make_unique<NumberExpr>(in.GetDouble()));
+                break;
+            case ST_CELL: {
+                const Position pos = UnpackPosition(in.GetU32());
+                if (!pos.IsValid()) {
+                    throw SnapshotException("Invalid position in formula");
+                }
+                cells.push_front(pos);
+                args.push_back(std::make_unique<CellExpr>(&cells.front()));
+                break;
+            }
+            case ST_RANGE: {
+                const Position first = UnpackPosition(in.GetU32());
+                const Position last = UnpackPosition(in.GetU32());
+                const Range range{first, last};
+                if (!range.IsValid()) {
+                    throw SnapshotException("Invalid range in formula");
+                }
+                ranges.push_front(range);
+                args.push_back(std::make_unique<RangeExpr>(&ranges.front()));
+                break;
+            }
+            case ST_FUNCTION: {
+                const std::uint8_t function = in.GetU8();
+                const std::uint32_t arg_count = in.GetU32();
+                if (function >= std::size(FUNCTION_NAMES) || arg_count == 0 || arg_count > args.size()) {
+                    throw SnapshotException("Malformed function call in formula");
+                }
+                std::vector<std::unique_ptr<Expr>> call_args(std::make_move_iterator(args.end() - arg_count),
+                                                             std::make_move_iterator(args.end()));
+                args.resize(args.size() - arg_count);
+                args.push_back(std::make_unique<FunctionExpr>(static_cast<Function>(function), std::move(call_args)));
+                break;
+            }
+            case ST_UNARY_PLUS:
+            case ST_UNARY_MINUS: {
+                auto operand = pop();
+                args.push_back(std::make_unique<UnaryOpExpr>(
+                    tag == ST_UNARY_MINUS ? UnaryOpExpr::UnaryMinus : UnaryOpExpr::UnaryPlus,
+                    std::move(operand)));
+                break;
+            }
+            case BinaryOpExpr::Add:
+            case BinaryOpExpr::Subtract:
+            case BinaryOpExpr::Multiply:
+            case BinaryOpExpr::Divide: {
+                auto rhs = pop();
+                auto lhs = pop();
+                args.push_back(std::make_unique<BinaryOpExpr>(
+                    static_cast<BinaryOpExpr::Type>(tag), std::move(lhs), std::move(rhs)));
+                break;
+            }
+            default:
+                throw SnapshotException("Unknown formula node");
+        }
+    }
+
+    if (args.size() != 1) {
+        throw SnapshotException("Malformed formula");
+    }
+
+    return FormulaAST(pop(), std::move(cells), std::move(ranges));
+}
+
+FormulaAST ParseFormulaAST(std::istream& in) {
+    const std::string in_str{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    return ParseFormulaAST(in_str);
+}
+
+FormulaAST ParseFormulaAST(std::string_view in_str) {
+#ifdef SPREADSHEET_ANTLR_PARSER
+    return ParseFormulaASTAntlr(std::string(in_str));
+#else
+    return ASTImpl::DirectParser(in_str).Parse();
+#endif
 }
 
 void FormulaAST::PrintCells(std::ostream& out) const {
@@ -471,21 +1650,61 @@ void FormulaAST::Print(std::ostream& out) const {
     root_expr_->Print(out);
 }
 
-void FormulaAST::PrintFormula(std::ostream& out) const {
-    root_expr_->PrintFormula(out, ASTImpl::EP_ATOM);
+void FormulaAST::PrintFormula(std::ostream& out, Position origin) const {
+    root_expr_->PrintFormula(out, ASTImpl::EP_ATOM, origin);
 }
 
 const std::forward_list<Position>& FormulaAST::GetReferencedCells() const {
     return cells_;
 }
 
-double FormulaAST::Execute(const ASTImpl::ArgCell& args) const {
-    return root_expr_->Evaluate(args);
+const std::forward_list<Range>& FormulaAST::GetReferencedRanges() const {
+    return ranges_;
+}
+
+void FormulaAST::Serialize(std::string& out, Position origin) const {
+    snapshot::Writer writer(out);
+    root_expr_->Serialize(writer, origin);
 }
 
-FormulaAST::FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<Position> cells)
+void FormulaAST::MakeRelative(Position origin) {
+    for (Position& cell : cells_) {
+        cell = {cell.row - origin.row, cell.col - origin.col};
+    }
+    for (Range& range : ranges_) {
+        range = {{range.first.row - origin.row, range.first.col - origin.col},
+                 {range.last.row - origin.row, range.last.col - origin.col}};
+    }
+    // The program keeps its own copies of the references
+    program_ = ASTImpl::Program();
+    root_expr_->Compile(program_);
+}
+
+std::string FormulaAST::GetRelativeKey() const {
+    std::string key;
+    snapshot::Writer writer(key);
+    root_expr_->Serialize(writer, std::nullopt);
+    return key;
+}
+
+ASTImpl::Value FormulaAST::Execute(const ASTImpl::ArgCell& args) const {
+    return program_.Execute(args);
+}
+
+void FormulaAST::ExecuteColumn(const ASTImpl::ArgCell& args, size_t count, ASTImpl::Value* results) const {
+    program_.ExecuteColumn(args, count, results);
+}
+
+FormulaAST::FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<Position> cells,
+                       std::forward_list<Range> ranges)
     : root_expr_(std::move(root_expr))
-    , cells_(std::move(cells)) {
+    , cells_(std::move(cells))
+    , ranges_(std::move(ranges)) {
+    root_expr_->Compile(program_);
 }
 
+FormulaAST::FormulaAST(FormulaAST&&) noexcept = default;
+
+FormulaAST& FormulaAST::operator=(FormulaAST&&) noexcept = default;
+
 FormulaAST::~FormulaAST() = default;
@@ -1,23 +1,147 @@
 #pragma once
 
+#include <cstdint>
 #include <forward_list>
 #include <functional>
+#include <iosfwd>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
-#include "FormulaLexer.h"
 #include "common.h"
 
+class Sheet;
+
 namespace ASTImpl {
+// Result of an evaluation step. Errors are passed by value rather than
+// thrown, so sheets full of #REF!/#VALUE!/#ARITHM! cells evaluate as fast
+// as clean ones.
+using Value = std::variant<double, FormulaError>;
+
+// Cell a reference points to when it is stored as an offset from origin
+inline Position Shift(Position offset, Position origin) {
+    return {origin.row + offset.row, origin.col + offset.col};
+}
+
+inline Range Shift(Range offsets, Position origin) {
+    return {Shift(offsets.first, origin), Shift(offsets.last, origin)};
+}
+
+// Aggregate functions a formula can call
+enum class Function : std::uint8_t {
+    Sum,
+    Average,
+    Min,
+    Max,
+    Count,
+};
+
 class ArgCell {
 public:
-    ArgCell(const SheetInterface& sheet);
-    double operator()(Position pos) const;
+    // References are resolved relative to origin
+    explicit ArgCell(const SheetInterface& sheet, Position origin = {0, 0});
+    // The number in the cell at origin + offset, or the error it turns into
+    Value operator()(Position offset) const;
+    // Same for count cells going down from origin + offset: numbers[i] gets
+    // the number i rows below, or 0 when that cell gives an error. The error
+    // goes to errors[i] unless failed[i] is already set, then failed[i] is set.
+    void LoadColumn(Position offset, size_t count, double* numbers, bool* failed, Value* errors) const;
+    // Accumulates the numbers in the range at origin + offsets, going down
+    // one column after another: total gets their sum (Sum, Average, Count),
+    // minimum (Min, +inf if none) or maximum (Max, -inf if none), count gets
+    // how many there are. Empty cells and text that is not a number are
+    // skipped. Returns the first error met, total and count are unspecified then.
+    std::optional<FormulaError> LoadRange(Range offsets, Function function, double& total,
+                                          double& count) const;
 private:
     const SheetInterface& sheet_;
+    Position origin_;
+    // This project's sheet, if it is one: its cells give numbers without reparsing text
+    const Sheet* concrete_sheet_;
 };
 
 class Expr;
+
+enum class OpCode : std::uint8_t {
+    PushNumber,  // arg - index in the number pool
+    LoadCell,    // arg - index in the cell pool
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Negate,
+    LoadRange,   // arg - index in the range pool; pushes the partial result
+                 // of the function over the range and the count of numbers
+    Aggregate,   // arg - index in the call pool; pops a partial result and
+                 // a count per argument, pushes the function result
+};
+
+struct Instruction {
+    OpCode op;
+    std::uint32_t arg;
+};
+
+// Formula compiled into postfix order: operands are pushed on a value stack,
+// operators pop their arguments and push the result.
+//
+// Emitting an operator simplifies the code where the result is bit-for-bit
+// the same: constant operands are folded unless the result is non-finite
+// (the error then still comes in evaluation order), double negations cancel
+// and x*1, 1*x, x/1, x-0 are dropped. x+0 is kept since -0+0 gives +0.
+class Program {
+public:
+    void EmitNumber(double value);
+    void EmitCell(Position pos);
+    // Negate
+    void EmitOp(OpCode op);
+    // Binary operator; rhs_begin is the code size before the right operand
+    // was emitted
+    void EmitOp(OpCode op, size_t rhs_begin);
+    // Function arguments: a range, or a value followed by EmitNumber(1) as
+    // its count. EmitCall comes after all arg_count of them.
+    void EmitRange(Range offsets, Function function);
+    void EmitCall(Function function, size_t arg_count);
+
+    size_t GetCodeSize() const;
+
+    // Stops at the first error in evaluation order: a referenced cell that
+    // can't be read as a number or a binary operation giving a non-finite
+    // result. The error is returned, never thrown.
+    Value Execute(const ArgCell& args) const;
+    // Executes the program for count origins going down a column from the
+    // args origin, one instruction at a time over all of them. results[i]
+    // gets what Execute gives i rows below.
+    void ExecuteColumn(const ArgCell& args, size_t count, Value* results) const;
+
+private:
+    static const size_t INLINE_STACK_SIZE = 32;
+
+    struct RangeArg {
+        Range offsets;
+        Function function;
+    };
+    struct Call {
+        Function function;
+        std::uint32_t arg_count;
+    };
+
+    std::vector<Instruction> code_;
+    std::vector<double> numbers_;
+    std::vector<Position> cells_;
+    std::vector<RangeArg> ranges_;
+    std::vector<Call> calls_;
+    size_t stack_depth_ = 0;
+    size_t max_stack_depth_ = 0;
+
+    void Emit(OpCode op, std::uint32_t arg, int stack_effect);
+    // Number pushed by the instruction at index if it is PushNumber
+    std::optional<double> GetNumber(size_t index) const;
+    void PopNumber();
+};
 }
 
 class ParsingError : public std::runtime_error {
@@ -27,22 +151,53 @@ class ParsingError : public std::runtime_error {
 class FormulaAST {
 public:
     explicit FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr,
-                        std::forward_list<Position> cells);
-    FormulaAST(FormulaAST&&) = default;
-    FormulaAST& operator=(FormulaAST&&) = default;
+                        std::forward_list<Position> cells,
+                        std::forward_list<Range> ranges = {});
+    FormulaAST(FormulaAST&&) noexcept;
+    FormulaAST& operator=(FormulaAST&&) noexcept;
     ~FormulaAST();
 
-    double Execute(const ASTImpl::ArgCell& args) const;
+    ASTImpl::Value Execute(const ASTImpl::ArgCell& args) const;
+    void ExecuteColumn(const ASTImpl::ArgCell& args, size_t count, ASTImpl::Value* results) const;
     void PrintCells(std::ostream& out) const;
     void Print(std::ostream& out) const;
-    void PrintFormula(std::ostream& out) const;
+    // Cell references are printed shifted by origin, see MakeRelative
+    void PrintFormula(std::ostream& out, Position origin = {0, 0}) const;
 
     const std::forward_list<Position>& GetReferencedCells() const;
+    // Ranges passed to functions, in the same form as the cells
+    const std::forward_list<Range>& GetReferencedRanges() const;
+
+    // Appends the tree in postfix order, see DeserializeFormulaAST. Cell
+    // references are written shifted by origin.
+    void Serialize(std::string& out, Position origin = {0, 0}) const;
+
+    // Stores cell references as offsets from origin, so that one tree can
+    // serve every cell of a filled-down block. Printing, serializing and
+    // evaluating with the cell position as origin give the original formula.
+    void MakeRelative(Position origin);
+    // Same for trees that differ only by where their cell references point
+    // to relative to their origins
+    std::string GetRelativeKey() const;
 
 private:
     std::unique_ptr<ASTImpl::Expr> root_expr_;
     std::forward_list<Position> cells_;
+    std::forward_list<Range> ranges_;
+    ASTImpl::Program program_;
 };
 
+// Parses a formula with the hand-written parser, or with the ANTLR one when
+// built with SPREADSHEET_ANTLR_PARSER.
 FormulaAST ParseFormulaAST(std::istream& in);
-FormulaAST ParseFormulaAST(const std::string& in_str);
\ No newline at end of file
+FormulaAST ParseFormulaAST(std::string_view in_str);
+
+// Reference parser generated by ANTLR from Formula.g4. Produces the same ASTs
+// as ParseFormulaAST and rejects the same inputs, except that the grammar has
+// no ranges and function calls: those are only known to the hand-written parser.
+FormulaAST ParseFormulaASTAntlr(std::istream& in);
+FormulaAST ParseFormulaASTAntlr(const std::string& in_str);
+
+// Rebuilds a tree written by FormulaAST::Serialize without parsing any text.
+// Throws SnapshotException on malformed data.
+FormulaAST DeserializeFormulaAST(std::string_view data);
\ No newline at end of file
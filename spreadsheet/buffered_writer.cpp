@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstddef>
+#include <ostream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "buffered_writer.h"
+
+namespace {
+// Записывает в дескриптор начало data, возвращает число записанных байт
+// или -1 с кодом ошибки в errno
+std::ptrdiff_t WriteToFd(int fd, std::string_view data) {
+#ifdef _WIN32
+    return _write(fd, data.data(), static_cast<unsigned int>(std::min<size_t>(data.size(), INT_MAX)));
+#else
+    return write(fd, data.data(), data.size());
+#endif
+}
+}  // namespace
+
+BufferedWriter::BufferedWriter(std::ostream& output)
+    : output_(&output) {
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+BufferedWriter::BufferedWriter(int fd)
+    : fd_(fd) {
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+BufferedWriter::BufferedWriter(std::string& output)
+    : string_output_(&output) {
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+BufferedWriter::~BufferedWriter() {
+    try {
+        Flush();
+    } catch (...) {
+    }
+}
+
+void BufferedWriter::Write(std::string_view text) {
+    if (buffer_.size() + text.size() > BUFFER_SIZE) {
+        Flush();
+    }
+    buffer_.append(text);
+}
+
+void BufferedWriter::Write(char c) {
+    if (buffer_.size() == BUFFER_SIZE) {
+        Flush();
+    }
+    buffer_.push_back(c);
+}
+
+void BufferedWriter::WriteNumber(double value) {
+    // Самая длинная запись - вида -1.23457e+308
+    char chars[32];
+    const auto result = std::to_chars(chars, chars + sizeof(chars), value, std::chars_format::general, 6);
+    Write(std::string_view(chars, result.ptr - chars));
+}
+
+void BufferedWriter::Flush() {
+    if (output_) {
+        output_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        return;
+    }
+    if (string_output_) {
+        string_output_->append(buffer_);
+        buffer_.clear();
+        return;
+    }
+
+    std::string_view rest(buffer_);
+    while (!rest.empty()) {
+        const std::ptrdiff_t written = WriteToFd(fd_, rest);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "write");
+        }
+        rest.remove_prefix(written);
+    }
+    buffer_.clear();
+}
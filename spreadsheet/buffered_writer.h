@@ -0,0 +1,37 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// Накапливает вывод в буфере и сбрасывает его крупными блоками в поток,
+// файловый дескриптор или строку. Числа форматируются std::to_chars без
+// учёта локали. Деструктор сбрасывает оставшиеся данные, но ошибки записи
+// при этом не сообщаются: чтобы узнать о них, вызовите Flush явно.
+class BufferedWriter {
+public:
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    explicit BufferedWriter(std::ostream& output);
+    explicit BufferedWriter(int fd);
+    explicit BufferedWriter(std::string& output);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    void Write(std::string_view text);
+    void Write(char c);
+    // Выводит число так же, как operator<< потока с настройками по
+    // умолчанию: формат %g с точностью 6
+    void WriteNumber(double value);
+
+    // Бросает std::system_error, если запись в дескриптор не удалась
+    void Flush();
+
+private:
+    std::ostream* output_ = nullptr;
+    std::string* string_output_ = nullptr;
+    int fd_ = -1;
+    std::string buffer_;
+};
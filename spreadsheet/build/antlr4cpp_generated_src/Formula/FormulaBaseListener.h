@@ -34,6 +34,15 @@ public:
   virtual void enterBinaryOp(FormulaParser::BinaryOpContext * /*ctx*/) override { }
   virtual void exitBinaryOp(FormulaParser::BinaryOpContext * /*ctx*/) override { }
 
+  virtual void enterCall(FormulaParser::CallContext * /*ctx*/) override { }
+  virtual void exitCall(FormulaParser::CallContext * /*ctx*/) override { }
+
+  virtual void enterArgument(FormulaParser::ArgumentContext * /*ctx*/) override { }
+  virtual void exitArgument(FormulaParser::ArgumentContext * /*ctx*/) override { }
+
+  virtual void enterRange(FormulaParser::RangeContext * /*ctx*/) override { }
+  virtual void exitRange(FormulaParser::RangeContext * /*ctx*/) override { }
+
 
   virtual void enterEveryRule(antlr4::ParserRuleContext * /*ctx*/) override { }
   virtual void exitEveryRule(antlr4::ParserRuleContext * /*ctx*/) override { }
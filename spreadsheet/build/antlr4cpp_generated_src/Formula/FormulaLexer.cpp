@@ -58,7 +58,7 @@ void formulalexerLexerInitialize() {
   auto staticData = std::make_unique<FormulaLexerStaticData>(
     std::vector<std::string>{
       "T__0", "T__1", "INT", "UINT", "EXPONENT", "NUMBER", "ADD", "SUB", 
-      "MUL", "DIV", "CELL", "WS"
+      "MUL", "DIV", "CELL", "NAME", "COLON", "COMMA", "WS"
     },
     std::vector<std::string>{
       "DEFAULT_TOKEN_CHANNEL", "HIDDEN"
@@ -67,39 +67,45 @@ void formulalexerLexerInitialize() {
       "DEFAULT_MODE"
     },
     std::vector<std::string>{
-      "", "'('", "')'", "", "'+'", "'-'", "'*'", "'/'"
+      "", "'('", "')'", "", "'+'", "'-'", "'*'", "'/'", "", "", "':'", "','"
     },
     std::vector<std::string>{
-      "", "", "", "NUMBER", "ADD", "SUB", "MUL", "DIV", "CELL", "WS"
+      "", "", "", "NUMBER", "ADD", "SUB", "MUL", "DIV", "CELL", "NAME", 
+      "COLON", "COMMA", "WS"
     }
   );
   static const int32_t serializedATNSegment[] = {
-  	4,0,9,81,6,-1,2,0,7,0,2,1,7,1,2,2,7,2,2,3,7,3,2,4,7,4,2,5,7,5,2,6,7,6,
-  	2,7,7,7,2,8,7,8,2,9,7,9,2,10,7,10,2,11,7,11,1,0,1,0,1,1,1,1,1,2,3,2,31,
-  	8,2,1,2,1,2,1,3,4,3,36,8,3,11,3,12,3,37,1,4,1,4,1,4,1,5,1,5,3,5,45,8,
-  	5,1,5,3,5,48,8,5,1,5,1,5,1,5,3,5,53,8,5,3,5,55,8,5,1,6,1,6,1,7,1,7,1,
-  	8,1,8,1,9,1,9,1,10,4,10,66,8,10,11,10,12,10,67,1,10,4,10,71,8,10,11,10,
-  	12,10,72,1,11,4,11,76,8,11,11,11,12,11,77,1,11,1,11,0,0,12,1,1,3,2,5,
-  	0,7,0,9,0,11,3,13,4,15,5,17,6,19,7,21,8,23,9,1,0,5,2,0,43,43,45,45,1,
-  	0,48,57,2,0,69,69,101,101,1,0,65,90,3,0,9,10,13,13,32,32,86,0,1,1,0,0,
-  	0,0,3,1,0,0,0,0,11,1,0,0,0,0,13,1,0,0,0,0,15,1,0,0,0,0,17,1,0,0,0,0,19,
-  	1,0,0,0,0,21,1,0,0,0,0,23,1,0,0,0,1,25,1,0,0,0,3,27,1,0,0,0,5,30,1,0,
-  	0,0,7,35,1,0,0,0,9,39,1,0,0,0,11,54,1,0,0,0,13,56,1,0,0,0,15,58,1,0,0,
-  	0,17,60,1,0,0,0,19,62,1,0,0,0,21,65,1,0,0,0,23,75,1,0,0,0,25,26,5,40,
-  	0,0,26,2,1,0,0,0,27,28,5,41,0,0,28,4,1,0,0,0,29,31,7,0,0,0,30,29,1,0,
-  	0,0,30,31,1,0,0,0,31,32,1,0,0,0,32,33,3,7,3,0,33,6,1,0,0,0,34,36,7,1,
-  	0,0,35,34,1,0,0,0,36,37,1,0,0,0,37,35,1,0,0,0,37,38,1,0,0,0,38,8,1,0,
-  	0,0,39,40,7,2,0,0,40,41,3,5,2,0,41,10,1,0,0,0,42,44,3,7,3,0,43,45,3,9,
-  	4,0,44,43,1,0,0,0,44,45,1,0,0,0,45,55,1,0,0,0,46,48,3,7,3,0,47,46,1,0,
-  	0,0,47,48,1,0,0,0,48,49,1,0,0,0,49,50,5,46,0,0,50,52,3,7,3,0,51,53,3,
-  	9,4,0,52,51,1,0,0,0,52,53,1,0,0,0,53,55,1,0,0,0,54,42,1,0,0,0,54,47,1,
-  	0,0,0,55,12,1,0,0,0,56,57,5,43,0,0,57,14,1,0,0,0,58,59,5,45,0,0,59,16,
-  	1,0,0,0,60,61,5,42,0,0,61,18,1,0,0,0,62,63,5,47,0,0,63,20,1,0,0,0,64,
-  	66,7,3,0,0,65,64,1,0,0,0,66,67,1,0,0,0,67,65,1,0,0,0,67,68,1,0,0,0,68,
-  	70,1,0,0,0,69,71,7,1,0,0,70,69,1,0,0,0,71,72,1,0,0,0,72,70,1,0,0,0,72,
-  	73,1,0,0,0,73,22,1,0,0,0,74,76,7,4,0,0,75,74,1,0,0,0,76,77,1,0,0,0,77,
-  	75,1,0,0,0,77,78,1,0,0,0,78,79,1,0,0,0,79,80,6,11,0,0,80,24,1,0,0,0,10,
-  	0,30,37,44,47,52,54,67,72,77,1,6,0,0
+  	4,0,12,96,6,-1,2,0,7,0,2,1,7,1,2,2,7,2,2,3,7,3,2,4,7,4,2,5,7,5,2,6,7,6,
+  	2,7,7,7,2,8,7,8,2,9,7,9,2,10,7,10,2,11,7,11,2,12,7,12,2,13,7,13,2,14,7,
+  	14,1,0,1,0,1,1,1,1,1,2,3,2,37,8,2,1,2,1,2,1,3,4,3,42,8,3,11,3,12,3,43,
+  	1,4,1,4,1,4,1,5,1,5,3,5,51,8,5,1,5,3,5,54,8,5,1,5,1,5,1,5,3,5,59,8,5,3,
+  	5,61,8,5,1,6,1,6,1,7,1,7,1,8,1,8,1,9,1,9,1,10,4,10,72,8,10,11,10,12,10,
+  	73,1,10,4,10,77,8,10,11,10,12,10,78,1,11,4,11,82,8,11,11,11,12,11,83,1,
+  	12,1,12,1,13,1,13,1,14,4,14,91,8,14,11,14,12,14,92,1,14,1,14,0,0,15,1,
+  	1,3,2,5,0,7,0,9,0,11,3,13,4,15,5,17,6,19,7,21,8,23,9,25,10,27,11,29,12,
+  	1,0,5,2,0,43,43,45,45,1,0,48,57,2,0,69,69,101,101,1,0,65,90,3,0,9,10,
+  	13,13,32,32,102,0,1,1,0,0,0,0,3,1,0,0,0,0,11,1,0,0,0,0,13,1,0,0,0,0,15,
+  	1,0,0,0,0,17,1,0,0,0,0,19,1,0,0,0,0,21,1,0,0,0,0,23,1,0,0,0,0,25,1,0,0,
+  	0,0,27,1,0,0,0,0,29,1,0,0,0,1,31,1,0,0,0,3,33,1,0,0,0,5,36,1,0,0,0,7,
+  	41,1,0,0,0,9,45,1,0,0,0,11,60,1,0,0,0,13,62,1,0,0,0,15,64,1,0,0,0,17,
+  	66,1,0,0,0,19,68,1,0,0,0,21,71,1,0,0,0,23,81,1,0,0,0,25,85,1,0,0,0,27,
+  	87,1,0,0,0,29,90,1,0,0,0,31,32,5,40,0,0,32,2,1,0,0,0,33,34,5,41,0,0,34,
+  	4,1,0,0,0,35,37,7,0,0,0,36,35,1,0,0,0,36,37,1,0,0,0,37,38,1,0,0,0,38,
+  	39,3,7,3,0,39,6,1,0,0,0,40,42,7,1,0,0,41,40,1,0,0,0,42,43,1,0,0,0,43,
+  	41,1,0,0,0,43,44,1,0,0,0,44,8,1,0,0,0,45,46,7,2,0,0,46,47,3,5,2,0,47,
+  	10,1,0,0,0,48,50,3,7,3,0,49,51,3,9,4,0,50,49,1,0,0,0,50,51,1,0,0,0,51,
+  	61,1,0,0,0,52,54,3,7,3,0,53,52,1,0,0,0,53,54,1,0,0,0,54,55,1,0,0,0,55,
+  	56,5,46,0,0,56,58,3,7,3,0,57,59,3,9,4,0,58,57,1,0,0,0,58,59,1,0,0,0,59,
+  	61,1,0,0,0,60,48,1,0,0,0,60,53,1,0,0,0,61,12,1,0,0,0,62,63,5,43,0,0,63,
+  	14,1,0,0,0,64,65,5,45,0,0,65,16,1,0,0,0,66,67,5,42,0,0,67,18,1,0,0,0,
+  	68,69,5,47,0,0,69,20,1,0,0,0,70,72,7,3,0,0,71,70,1,0,0,0,72,73,1,0,0,0,
+  	73,71,1,0,0,0,73,74,1,0,0,0,74,76,1,0,0,0,75,77,7,1,0,0,76,75,1,0,0,0,
+  	77,78,1,0,0,0,78,76,1,0,0,0,78,79,1,0,0,0,79,22,1,0,0,0,80,82,7,3,0,0,
+  	81,80,1,0,0,0,82,83,1,0,0,0,83,81,1,0,0,0,83,84,1,0,0,0,84,24,1,0,0,0,
+  	85,86,5,58,0,0,86,26,1,0,0,0,87,88,5,44,0,0,88,28,1,0,0,0,89,91,7,4,0,
+  	0,90,89,1,0,0,0,91,92,1,0,0,0,92,90,1,0,0,0,92,93,1,0,0,0,93,94,1,0,0,
+  	0,94,95,6,14,0,0,95,30,1,0,0,0,11,0,36,43,50,53,58,60,73,78,83,92,1,6,
+  	0,0
   };
   staticData->serializedATN = antlr4::atn::SerializedATNView(serializedATNSegment, sizeof(serializedATNSegment) / sizeof(serializedATNSegment[0]));
 
@@ -32,6 +32,15 @@ public:
   virtual void enterBinaryOp(FormulaParser::BinaryOpContext *ctx) = 0;
   virtual void exitBinaryOp(FormulaParser::BinaryOpContext *ctx) = 0;
 
+  virtual void enterCall(FormulaParser::CallContext *ctx) = 0;
+  virtual void exitCall(FormulaParser::CallContext *ctx) = 0;
+
+  virtual void enterArgument(FormulaParser::ArgumentContext *ctx) = 0;
+  virtual void exitArgument(FormulaParser::ArgumentContext *ctx) = 0;
+
+  virtual void enterRange(FormulaParser::RangeContext *ctx) = 0;
+  virtual void exitRange(FormulaParser::RangeContext *ctx) = 0;
+
 
 };
 
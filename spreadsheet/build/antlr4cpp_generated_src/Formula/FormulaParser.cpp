@@ -52,25 +52,32 @@ void formulaParserInitialize() {
 #endif
   auto staticData = std::make_unique<FormulaParserStaticData>(
     std::vector<std::string>{
-      "main", "expr"
+      "main", "expr", "arg"
     },
     std::vector<std::string>{
-      "", "'('", "')'", "", "'+'", "'-'", "'*'", "'/'"
+      "", "'('", "')'", "", "'+'", "'-'", "'*'", "'/'", "", "", "':'", "','"
     },
     std::vector<std::string>{
-      "", "", "", "NUMBER", "ADD", "SUB", "MUL", "DIV", "CELL", "WS"
+      "", "", "", "NUMBER", "ADD", "SUB", "MUL", "DIV", "CELL", "NAME", 
+      "COLON", "COMMA", "WS"
     }
   );
   static const int32_t serializedATNSegment[] = {
-  	4,1,9,30,2,0,7,0,2,1,7,1,1,0,1,0,1,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
-  	1,1,3,1,17,8,1,1,1,1,1,1,1,1,1,1,1,1,1,5,1,25,8,1,10,1,12,1,28,9,1,1,
-  	1,0,1,2,2,0,2,0,2,1,0,4,5,1,0,6,7,32,0,4,1,0,0,0,2,16,1,0,0,0,4,5,3,2,
-  	1,0,5,6,5,0,0,1,6,1,1,0,0,0,7,8,6,1,-1,0,8,9,5,1,0,0,9,10,3,2,1,0,10,
-  	11,5,2,0,0,11,17,1,0,0,0,12,13,7,0,0,0,13,17,3,2,1,5,14,17,5,8,0,0,15,
-  	17,5,3,0,0,16,7,1,0,0,0,16,12,1,0,0,0,16,14,1,0,0,0,16,15,1,0,0,0,17,
-  	26,1,0,0,0,18,19,10,4,0,0,19,20,7,1,0,0,20,25,3,2,1,5,21,22,10,3,0,0,
-  	22,23,7,0,0,0,23,25,3,2,1,4,24,18,1,0,0,0,24,21,1,0,0,0,25,28,1,0,0,0,
-  	26,24,1,0,0,0,26,27,1,0,0,0,27,3,1,0,0,0,28,26,1,0,0,0,3,16,24,26
+  	4,1,12,49,2,0,7,0,2,1,7,1,2,2,7,2,1,0,1,0,1,0,1,1,1,1,1,1,1,1,1,1,1,1,
+  	1,1,1,1,1,1,1,1,1,1,1,1,5,1,22,8,1,10,1,12,1,25,9,1,1,1,1,1,1,1,3,1,30,
+  	8,1,1,1,1,1,1,1,1,1,1,1,1,1,5,1,38,8,1,10,1,12,1,41,9,1,1,1,1,2,1,2,1,
+  	2,1,2,3,2,48,8,2,0,1,2,3,0,2,4,0,2,1,0,4,5,1,0,6,7,53,0,6,1,0,0,0,2,29,
+  	1,0,0,0,4,47,1,0,0,0,6,7,3,2,1,0,7,8,5,0,0,1,8,1,1,0,0,0,9,10,6,1,-1,0,
+  	10,11,5,1,0,0,11,12,3,2,1,0,12,13,5,2,0,0,13,30,1,0,0,0,14,15,7,0,0,0,
+  	15,30,3,2,1,6,16,17,5,9,0,0,17,18,5,1,0,0,18,23,3,4,2,0,19,20,5,11,0,0,
+  	20,22,3,4,2,0,21,19,1,0,0,0,22,25,1,0,0,0,23,21,1,0,0,0,23,24,1,0,0,0,
+  	24,26,1,0,0,0,25,23,1,0,0,0,26,30,5,2,0,0,27,30,5,8,0,0,28,30,5,3,0,0,
+  	29,9,1,0,0,0,29,14,1,0,0,0,29,16,1,0,0,0,29,27,1,0,0,0,29,28,1,0,0,0,
+  	30,39,1,0,0,0,31,32,10,5,0,0,32,33,7,1,0,0,33,38,3,2,1,6,34,35,10,4,0,
+  	0,35,36,7,0,0,0,36,38,3,2,1,5,37,31,1,0,0,0,37,34,1,0,0,0,38,41,1,0,0,
+  	0,39,37,1,0,0,0,39,40,1,0,0,0,40,3,1,0,0,0,41,39,1,0,0,0,43,44,5,8,0,0,
+  	44,45,5,10,0,0,45,48,5,8,0,0,46,48,3,2,1,0,47,43,1,0,0,0,47,46,1,0,0,0,
+  	48,5,1,0,0,0,5,23,29,37,39,47
   };
   staticData->serializedATN = antlr4::atn::SerializedATNView(serializedATNSegment, sizeof(serializedATNSegment) / sizeof(serializedATNSegment[0]));
 
@@ -163,9 +170,9 @@ FormulaParser::MainContext* FormulaParser::main() {
   });
   try {
     enterOuterAlt(_localctx, 1);
-    setState(4);
+    setState(6);
     expr(0);
-    setState(5);
+    setState(7);
     match(FormulaParser::EOF);
    
   }
@@ -311,6 +318,40 @@ void FormulaParser::BinaryOpContext::exitRule(tree::ParseTreeListener *listener)
   if (parserListener != nullptr)
     parserListener->exitBinaryOp(this);
 }
+//----------------- CallContext ------------------------------------------------------------------
+
+tree::TerminalNode* FormulaParser::CallContext::NAME() {
+  return getToken(FormulaParser::NAME, 0);
+}
+
+std::vector<FormulaParser::ArgContext *> FormulaParser::CallContext::arg() {
+  return getRuleContexts<FormulaParser::ArgContext>();
+}
+
+FormulaParser::ArgContext* FormulaParser::CallContext::arg(size_t i) {
+  return getRuleContext<FormulaParser::ArgContext>(i);
+}
+
+std::vector<tree::TerminalNode *> FormulaParser::CallContext::COMMA() {
+  return getTokens(FormulaParser::COMMA);
+}
+
+tree::TerminalNode* FormulaParser::CallContext::COMMA(size_t i) {
+  return getToken(FormulaParser::COMMA, i);
+}
+
+FormulaParser::CallContext::CallContext(ExprContext *ctx) { copyFrom(ctx); }
+
+void FormulaParser::CallContext::enterRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->enterCall(this);
+}
+void FormulaParser::CallContext::exitRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->exitCall(this);
+}
 
 FormulaParser::ExprContext* FormulaParser::expr() {
    return expr(0);
@@ -337,7 +378,7 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
   try {
     size_t alt;
     enterOuterAlt(_localctx, 1);
-    setState(16);
+    setState(29);
     _errHandler->sync(this);
     switch (_input->LA(1)) {
       case FormulaParser::T__0: {
@@ -345,11 +386,11 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
         _ctx = _localctx;
         previousContext = _localctx;
 
-        setState(8);
+        setState(10);
         match(FormulaParser::T__0);
-        setState(9);
+        setState(11);
         expr(0);
-        setState(10);
+        setState(12);
         match(FormulaParser::T__1);
         break;
       }
@@ -359,7 +400,7 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
         _localctx = _tracker.createInstance<UnaryOpContext>(_localctx);
         _ctx = _localctx;
         previousContext = _localctx;
-        setState(12);
+        setState(14);
         _la = _input->LA(1);
         if (!(_la == FormulaParser::ADD
 
@@ -370,8 +411,35 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
           _errHandler->reportMatch(this);
           consume();
         }
-        setState(13);
-        expr(5);
+        setState(15);
+        expr(6);
+        break;
+      }
+
+      case FormulaParser::NAME: {
+        _localctx = _tracker.createInstance<CallContext>(_localctx);
+        _ctx = _localctx;
+        previousContext = _localctx;
+        setState(16);
+        match(FormulaParser::NAME);
+        setState(17);
+        match(FormulaParser::T__0);
+        setState(18);
+        arg();
+        setState(23);
+        _errHandler->sync(this);
+        _la = _input->LA(1);
+        while (_la == FormulaParser::COMMA) {
+          setState(19);
+          match(FormulaParser::COMMA);
+          setState(20);
+          arg();
+          setState(25);
+          _errHandler->sync(this);
+          _la = _input->LA(1);
+        }
+        setState(26);
+        match(FormulaParser::T__1);
         break;
       }
 
@@ -379,7 +447,7 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
         _localctx = _tracker.createInstance<CellContext>(_localctx);
         _ctx = _localctx;
         previousContext = _localctx;
-        setState(14);
+        setState(27);
         match(FormulaParser::CELL);
         break;
       }
@@ -388,7 +456,7 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
         _localctx = _tracker.createInstance<LiteralContext>(_localctx);
         _ctx = _localctx;
         previousContext = _localctx;
-        setState(15);
+        setState(28);
         match(FormulaParser::NUMBER);
         break;
       }
@@ -397,25 +465,25 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
       throw NoViableAltException(this);
     }
     _ctx->stop = _input->LT(-1);
-    setState(26);
+    setState(39);
     _errHandler->sync(this);
-    alt = getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 2, _ctx);
+    alt = getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 3, _ctx);
     while (alt != 2 && alt != atn::ATN::INVALID_ALT_NUMBER) {
       if (alt == 1) {
         if (!_parseListeners.empty())
           triggerExitRuleEvent();
         previousContext = _localctx;
-        setState(24);
+        setState(37);
         _errHandler->sync(this);
-        switch (getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 1, _ctx)) {
+        switch (getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 2, _ctx)) {
         case 1: {
           auto newContext = _tracker.createInstance<BinaryOpContext>(_tracker.createInstance<ExprContext>(parentContext, parentState));
           _localctx = newContext;
           pushNewRecursionContext(newContext, startState, RuleExpr);
-          setState(18);
+          setState(31);
 
-          if (!(precpred(_ctx, 4))) throw FailedPredicateException(this, "precpred(_ctx, 4)");
-          setState(19);
+          if (!(precpred(_ctx, 5))) throw FailedPredicateException(this, "precpred(_ctx, 5)");
+          setState(32);
           _la = _input->LA(1);
           if (!(_la == FormulaParser::MUL
 
@@ -426,8 +494,8 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
             _errHandler->reportMatch(this);
             consume();
           }
-          setState(20);
-          expr(5);
+          setState(33);
+          expr(6);
           break;
         }
 
@@ -435,10 +503,10 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
           auto newContext = _tracker.createInstance<BinaryOpContext>(_tracker.createInstance<ExprContext>(parentContext, parentState));
           _localctx = newContext;
           pushNewRecursionContext(newContext, startState, RuleExpr);
-          setState(21);
+          setState(34);
 
-          if (!(precpred(_ctx, 3))) throw FailedPredicateException(this, "precpred(_ctx, 3)");
-          setState(22);
+          if (!(precpred(_ctx, 4))) throw FailedPredicateException(this, "precpred(_ctx, 4)");
+          setState(35);
           _la = _input->LA(1);
           if (!(_la == FormulaParser::ADD
 
@@ -449,8 +517,8 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
             _errHandler->reportMatch(this);
             consume();
           }
-          setState(23);
-          expr(4);
+          setState(36);
+          expr(5);
           break;
         }
 
@@ -458,9 +526,9 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
           break;
         } 
       }
-      setState(28);
+      setState(41);
       _errHandler->sync(this);
-      alt = getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 2, _ctx);
+      alt = getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 3, _ctx);
     }
   }
   catch (RecognitionException &e) {
@@ -471,6 +539,114 @@ FormulaParser::ExprContext* FormulaParser::expr(int precedence) {
   return _localctx;
 }
 
+//----------------- ArgContext ------------------------------------------------------------------
+
+FormulaParser::ArgContext::ArgContext(ParserRuleContext *parent, size_t invokingState)
+  : ParserRuleContext(parent, invokingState) {
+}
+
+
+size_t FormulaParser::ArgContext::getRuleIndex() const {
+  return FormulaParser::RuleArg;
+}
+
+void FormulaParser::ArgContext::copyFrom(ArgContext *ctx) {
+  ParserRuleContext::copyFrom(ctx);
+}
+
+//----------------- ArgumentContext ------------------------------------------------------------------
+
+FormulaParser::ExprContext* FormulaParser::ArgumentContext::expr() {
+  return getRuleContext<FormulaParser::ExprContext>(0);
+}
+
+FormulaParser::ArgumentContext::ArgumentContext(ArgContext *ctx) { copyFrom(ctx); }
+
+void FormulaParser::ArgumentContext::enterRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->enterArgument(this);
+}
+void FormulaParser::ArgumentContext::exitRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->exitArgument(this);
+}
+//----------------- RangeContext ------------------------------------------------------------------
+
+std::vector<tree::TerminalNode *> FormulaParser::RangeContext::CELL() {
+  return getTokens(FormulaParser::CELL);
+}
+
+tree::TerminalNode* FormulaParser::RangeContext::CELL(size_t i) {
+  return getToken(FormulaParser::CELL, i);
+}
+
+tree::TerminalNode* FormulaParser::RangeContext::COLON() {
+  return getToken(FormulaParser::COLON, 0);
+}
+
+FormulaParser::RangeContext::RangeContext(ArgContext *ctx) { copyFrom(ctx); }
+
+void FormulaParser::RangeContext::enterRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->enterRange(this);
+}
+void FormulaParser::RangeContext::exitRule(tree::ParseTreeListener *listener) {
+  auto parserListener = dynamic_cast<FormulaListener *>(listener);
+  if (parserListener != nullptr)
+    parserListener->exitRange(this);
+}
+FormulaParser::ArgContext* FormulaParser::arg() {
+  ArgContext *_localctx = _tracker.createInstance<ArgContext>(_ctx, getState());
+  enterRule(_localctx, 4, FormulaParser::RuleArg);
+
+#if __cplusplus > 201703L
+  auto onExit = finally([=, this] {
+#else
+  auto onExit = finally([=] {
+#endif
+    exitRule();
+  });
+  try {
+    setState(47);
+    _errHandler->sync(this);
+    switch (getInterpreter<atn::ParserATNSimulator>()->adaptivePredict(_input, 4, _ctx)) {
+    case 1: {
+      _localctx = _tracker.createInstance<FormulaParser::RangeContext>(_localctx);
+      enterOuterAlt(_localctx, 1);
+      setState(43);
+      match(FormulaParser::CELL);
+      setState(44);
+      match(FormulaParser::COLON);
+      setState(45);
+      match(FormulaParser::CELL);
+      break;
+    }
+
+    case 2: {
+      _localctx = _tracker.createInstance<FormulaParser::ArgumentContext>(_localctx);
+      enterOuterAlt(_localctx, 2);
+      setState(46);
+      expr(0);
+      break;
+    }
+
+    default:
+      break;
+    }
+   
+  }
+  catch (RecognitionException &e) {
+    _errHandler->reportError(this, e);
+    _localctx->exception = std::current_exception();
+    _errHandler->recover(this, _localctx->exception);
+  }
+
+  return _localctx;
+}
+
 bool FormulaParser::sempred(RuleContext *context, size_t ruleIndex, size_t predicateIndex) {
   switch (ruleIndex) {
     case 1: return exprSempred(antlrcpp::downCast<ExprContext *>(context), predicateIndex);
@@ -483,8 +659,8 @@ bool FormulaParser::sempred(RuleContext *context, size_t ruleIndex, size_t predi
 
 bool FormulaParser::exprSempred(ExprContext *_localctx, size_t predicateIndex) {
   switch (predicateIndex) {
-    case 0: return precpred(_ctx, 4);
-    case 1: return precpred(_ctx, 3);
+    case 0: return precpred(_ctx, 5);
+    case 1: return precpred(_ctx, 4);
 
   default:
     break;
@@ -13,11 +13,11 @@ class  FormulaParser : public antlr4::Parser {
 public:
   enum {
     T__0 = 1, T__1 = 2, NUMBER = 3, ADD = 4, SUB = 5, MUL = 6, DIV = 7, 
-    CELL = 8, WS = 9
+    CELL = 8, NAME = 9, COLON = 10, COMMA = 11, WS = 12
   };
 
   enum {
-    RuleMain = 0, RuleExpr = 1
+    RuleMain = 0, RuleExpr = 1, RuleArg = 2
   };
 
   explicit FormulaParser(antlr4::TokenStream *input);
@@ -38,7 +38,8 @@ public:
 
 
   class MainContext;
-  class ExprContext; 
+  class ExprContext;
+  class ArgContext; 
 
   class  MainContext : public antlr4::ParserRuleContext {
   public:
@@ -105,6 +106,19 @@ public:
     virtual void exitRule(antlr4::tree::ParseTreeListener *listener) override;
   };
 
+  class  CallContext : public ExprContext {
+  public:
+    CallContext(ExprContext *ctx);
+
+    antlr4::tree::TerminalNode *NAME();
+    std::vector<ArgContext *> arg();
+    ArgContext* arg(size_t i);
+    std::vector<antlr4::tree::TerminalNode *> COMMA();
+    antlr4::tree::TerminalNode* COMMA(size_t i);
+    virtual void enterRule(antlr4::tree::ParseTreeListener *listener) override;
+    virtual void exitRule(antlr4::tree::ParseTreeListener *listener) override;
+  };
+
   class  BinaryOpContext : public ExprContext {
   public:
     BinaryOpContext(ExprContext *ctx);
@@ -121,6 +135,41 @@ public:
 
   ExprContext* expr();
   ExprContext* expr(int precedence);
+  class  ArgContext : public antlr4::ParserRuleContext {
+  public:
+    ArgContext(antlr4::ParserRuleContext *parent, size_t invokingState);
+   
+    ArgContext() = default;
+    void copyFrom(ArgContext *context);
+    using antlr4::ParserRuleContext::copyFrom;
+
+    virtual size_t getRuleIndex() const override;
+
+   
+  };
+
+  class  ArgumentContext : public ArgContext {
+  public:
+    ArgumentContext(ArgContext *ctx);
+
+    ExprContext *expr();
+    virtual void enterRule(antlr4::tree::ParseTreeListener *listener) override;
+    virtual void exitRule(antlr4::tree::ParseTreeListener *listener) override;
+  };
+
+  class  RangeContext : public ArgContext {
+  public:
+    RangeContext(ArgContext *ctx);
+
+    std::vector<antlr4::tree::TerminalNode *> CELL();
+    antlr4::tree::TerminalNode* CELL(size_t i);
+    antlr4::tree::TerminalNode *COLON();
+    virtual void enterRule(antlr4::tree::ParseTreeListener *listener) override;
+    virtual void exitRule(antlr4::tree::ParseTreeListener *listener) override;
+  };
+
+  ArgContext* arg();
+
 
   bool sempred(antlr4::RuleContext *_localctx, size_t ruleIndex, size_t predicateIndex) override;
 
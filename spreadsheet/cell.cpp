@@ -1,9 +1,9 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <string>
 #include <optional>
-#include <queue>
-#include <unordered_set>
+#include <unordered_map>
 
 #include "cell.h"
 #include "sheet.h"
@@ -17,114 +17,383 @@ class Cell::Impl {
 public:
     virtual ~Impl() = default;
 
-    virtual Cell::Value GetValue() const;
-    virtual std::string GetText() const;
+    // Вычисляет значение формулы, если оно ещё не в кеше
+    virtual const FormulaInterface::Value& Evaluate() const;
     virtual std::vector<Position> GetReferencedCells() const;
+    virtual std::vector<Range> GetReferencedRanges() const;
+    virtual const FormulaInterface* GetFormula() const;
+    virtual void InvalidateCache() const;
+
+    // Невиртуальный доступ к данным, общим для всех видов ячеек
+    bool IsFormula() const;
+    bool IsDirty() const;
+    std::string_view GetTextView() const;
+    // Видимое значение текстовой ячейки: текст без экранирующего апострофа
+    std::string_view GetValueTextView() const;
+    // Значение как аргумента формулы или nullptr, если формула не вычислена
+    const FormulaInterface::Value* GetCachedNumericValue() const;
+    // Запоминает значение формулы, вычисленное вне ячейки
+    void SetCachedNumericValue(const FormulaInterface::Value& value) const;
 
 protected:
-    Cell::Value value_ = ""s;
     std::string text_ = ""s;
+    size_t value_offset_ = 0;
+    bool is_formula_ = false;
+    // Для текста задаётся при установке, для формулы служит кешем значения
+    mutable std::optional<FormulaInterface::Value> numeric_ = FormulaInterface::Value(0.0);
 };
 
 class Cell::EmptyImpl final : public Impl {};
 
 class Cell::TextImpl final : public Impl {
 public:
-    TextImpl(const std::string& text);
+    TextImpl(std::string text);
 };
 
 class Cell::FormulaImpl : public Impl {
 public:
-    FormulaImpl(const std::string& formula, const SheetInterface& sheet);
-    
-    bool IsValidCache() const;
-    void InvalidateCache() const;
+    FormulaImpl(std::string_view formula, Position pos, Sheet& sheet);
+    FormulaImpl(std::string text, std::unique_ptr<FormulaInterface> formula,
+                const SheetInterface& sheet);
 
-    Cell::Value GetValue() const override;
+    const FormulaInterface::Value& Evaluate() const override;
+    void InvalidateCache() const override;
     std::vector<Position> GetReferencedCells() const override;
+    std::vector<Range> GetReferencedRanges() const override;
+    const FormulaInterface* GetFormula() const override;
 private:
     const SheetInterface& sheet_;
     std::unique_ptr<FormulaInterface> formula_;
-    mutable std::optional<FormulaInterface::Value> cache_; 
 };
 
 Cell::~Cell() = default;
 
 Cell::Cell(Sheet& sheet) : sheet_(sheet),
+                           order_(sheet.TakeOrderAfterAll()),
                            impl_(make_unique<EmptyImpl>()) {
 }
 
-void Cell::Set(std::string text) { 
-    if(text.size() == 0) {
-        impl_ = make_unique<EmptyImpl>();
-    } else if (text.size() > 1 && text[0] == FORMULA_SIGN) {
-        std::unique_ptr<Impl> test_impl;
-        test_impl = make_unique<FormulaImpl>(std::move(text), sheet_);
-        
-        if(IsCircularDependency(*test_impl)) {
-            throw CircularDependencyException(""s);
-        }
-        impl_ = std::move(test_impl);
-    } else {
-        impl_ = make_unique<TextImpl>(std::move(text));
+void Cell::Set(std::string text, Position pos) { 
+    Set(Parse(std::move(text), pos, sheet_));
+}
+
+void Cell::Set(Content content) {
+    assert(content.GetReferencedRanges().empty());
+    const std::vector<Cell*> referenced = GetOrCreateReferences(*content.impl_);
+
+    if(IsCircularDependency(referenced)) {
+        throw CircularDependencyException(""s);
     }
+    impl_ = std::move(content.impl_);
     
     ClearCellInfo();
-    UpdateLinkedAndReferencedContainers();
+    UpdateLinkedAndReferencedContainers(referenced);
     InvalidateCacheRecursive();
 }
 
+Cell::Content Cell::Parse(std::string text, Position pos, Sheet& sheet) {
+    if(text.size() == 0) {
+        return Content(make_unique<EmptyImpl>());
+    } else if (text.size() > 1 && text[0] == FORMULA_SIGN) {
+        return Content(make_unique<FormulaImpl>(text, pos, sheet));
+    }
+    return Content(make_unique<TextImpl>(std::move(text)));
+}
+
+Cell::Content Cell::Parse(std::string_view text, Position pos, Sheet& sheet) {
+    if(text.size() > 1 && text[0] == FORMULA_SIGN) {
+        return Content(make_unique<FormulaImpl>(text, pos, sheet));
+    }
+    return Parse(std::string(text), pos, sheet);
+}
+
+Cell::Content Cell::FromFormula(std::string text, std::unique_ptr<FormulaInterface> formula,
+                                Sheet& sheet) {
+    return Content(make_unique<FormulaImpl>(std::move(text), std::move(formula), sheet));
+}
+
+void Cell::SetMany(const std::vector<Cell*>& cells, std::vector<Content> contents,
+                   const std::vector<std::vector<Cell*>>& references,
+                   const std::vector<Cell*>& range_dependents) {
+    if(cells.empty()) {
+        return;
+    }
+    Sheet& sheet = cells.front()->sheet_;
+
+    if(HasCycle(cells, references)) {
+        throw CircularDependencyException(""s);
+    }
+
+    for(size_t i = 0; i < cells.size(); ++i) {
+        if(contents[i].impl_) {
+            cells[i]->impl_ = std::move(contents[i].impl_);
+        }
+        cells[i]->ClearCellInfo();
+    }
+
+    // Циклов нет, поэтому рёбра можно добавлять по одному, поддерживая
+    // топологический порядок без повторных проверок
+    for(size_t i = 0; i < cells.size(); ++i) {
+        cells[i]->OrderAfter(references[i]);
+        cells[i]->UpdateLinkedAndReferencedContainers(references[i]);
+    }
+
+    std::vector<Cell*> changed = cells;
+    changed.insert(changed.end(), range_dependents.begin(), range_dependents.end());
+    InvalidateCaches(sheet, changed);
+}
+
 void Cell::Clear() {
-    Set(""s);
+    // Позиция нужна только формулам
+    Set(""s, Position::NONE);
 }
 
 Cell::Value Cell::GetValue() const {
-    return impl_->GetValue();
+    if(!impl_->IsFormula()) {
+        return std::string(impl_->GetValueTextView());
+    }
+
+    const FormulaInterface::Value value = GetNumericValue();
+    if(const double* number = std::get_if<double>(&value)) {
+        return *number;
+    }
+    return std::get<FormulaError>(value);
+}
+
+FormulaInterface::Value Cell::GetNumericValue() const {
+    if(const auto* value = impl_->GetCachedNumericValue()) {
+        return *value;
+    }
+
+    if(HasDirtyReferences()) {
+        EvaluateDirtyReferences();
+    }
+    return impl_->Evaluate();
+}
+
+std::optional<FormulaInterface::Value> Cell::GetRangeValue() const {
+    if(impl_->IsFormula()) {
+        return GetNumericValue();
+    }
+
+    const FormulaInterface::Value* value = impl_->GetCachedNumericValue();
+    if(impl_->GetValueTextView().empty() || std::holds_alternative<FormulaError>(*value)) {
+        return std::nullopt;
+    }
+    return *value;
+}
+
+std::optional<double> Cell::TryGetNumber() const {
+    const FormulaInterface::Value value = GetNumericValue();
+    if(const double* number = std::get_if<double>(&value)) {
+        return *number;
+    }
+    return std::nullopt;
+}
+
+Cell::ValueView Cell::GetValueView() const {
+    if(!impl_->IsFormula()) {
+        return impl_->GetValueTextView();
+    }
+
+    const FormulaInterface::Value value = GetNumericValue();
+    if(const double* number = std::get_if<double>(&value)) {
+        return *number;
+    }
+    return std::get<FormulaError>(value);
 }
 
 std::string Cell::GetText() const {
-    return impl_->GetText();
+    return std::string(impl_->GetTextView());
+}
+
+std::string_view Cell::GetTextView() const {
+    return impl_->GetTextView();
+}
+
+bool Cell::IsEmpty() const {
+    return impl_->GetTextView().empty();
 }
 
 std::vector<Position> Cell::GetReferencedCells() const {
     return impl_->GetReferencedCells();
 }
 
+std::vector<Range> Cell::GetReferencedRanges() const {
+    return impl_->GetReferencedRanges();
+}
+
+const FormulaInterface* Cell::GetFormula() const {
+    return impl_->GetFormula();
+}
+
 bool Cell::IsReferenced() const {
     return !linked_cells_.empty();
 }
 
-bool Cell::IsCircularDependency(const Impl& new_impl) {
-    const auto referenced_cells = new_impl.GetReferencedCells();
-    if (referenced_cells.empty()){
+bool Cell::IsDirty() const {
+    return impl_->IsDirty();
+}
+
+void Cell::EvaluateColumn(std::vector<Cell*>::const_iterator first,
+                          std::vector<Cell*>::const_iterator last) {
+    const Cell& top = **first;
+    std::vector<FormulaInterface::Value> values(last - first, 0.0);
+    ::EvaluateColumn(*top.GetFormula(), values.size(), top.sheet_, values.data());
+
+    for(size_t i = 0; i < values.size(); ++i) {
+        first[i]->impl_->SetCachedNumericValue(values[i]);
+    }
+}
+
+std::vector<std::vector<Cell*>> Cell::SplitIntoLevels(std::vector<Cell*> dirty_cells) {
+    // В топологическом порядке ссылки обрабатываются раньше ссылающихся ячеек
+    std::sort(dirty_cells.begin(), dirty_cells.end(), [](const Cell* lhs, const Cell* rhs) {
+        return lhs->order_ < rhs->order_;
+    });
+
+    std::unordered_map<const Cell*, size_t> levels;
+    levels.reserve(dirty_cells.size());
+    std::vector<std::vector<Cell*>> result;
+
+    for (Cell* cell : dirty_cells) {
+        size_t level = 0;
+        for (const Cell* referenced_cell : cell->referenced_cells_) {
+            const auto it = levels.find(referenced_cell);
+            if (it != levels.end()) {
+                level = std::max(level, it->second + 1);
+            }
+        }
+
+        levels[cell] = level;
+        if (level == result.size()) {
+            result.emplace_back();
+        }
+        result[level].push_back(cell);
+    }
+
+    return result;
+}
+
+// Проверяет, не замкнёт ли новая формула цикл, и, если нет, переставляет
+// ячейки так, чтобы текущая шла после всех ячеек, на которые она будет
+// ссылаться. Порядок поддерживается инкрементально (алгоритм Пирса-Келли):
+// если ссылка уже согласована с порядком, проверка стоит O(1), иначе
+// обходится только участок графа между номерами двух ячеек.
+bool Cell::IsCircularDependency(const std::vector<Cell*>& referenced) {
+    if (referenced.empty()){
         return false;
     }
 
-    std::queue<const Cell*> to_visit;
+    return OrderAfter(referenced);
+}
+
+std::vector<Cell*> Cell::GetOrCreateReferences(const Impl& impl) {
+    const auto referenced_cells = impl.GetReferencedCells();
+
+    std::vector<Cell*> referenced;
+    referenced.reserve(referenced_cells.size());
     for (const auto& pos : referenced_cells) {
         Cell* cell = sheet_.GetConcreteCell(pos);
 
         if(!cell) {
             sheet_.SetCell(pos, ""s);
+            cell = sheet_.GetConcreteCell(pos);
         }
-        to_visit.push(sheet_.GetConcreteCell(pos));
+        referenced.push_back(cell);
     }
 
-    std::unordered_set<const Cell*> visited;
+    return referenced;
+}
 
-    while (!to_visit.empty()) {
-        const Cell* current = to_visit.front();
-        
-        if (this == current){
+// Переставляет ячейки так, чтобы текущая шла после referenced. Возвращает
+// true, если это невозможно из-за цикла.
+bool Cell::OrderAfter(const std::vector<Cell*>& referenced) {
+    if (std::find(referenced.begin(), referenced.end(), this) != referenced.end()) {
+        return true;
+    }
+
+    // От ячейки без зависимых ничего не достижимо: её можно поставить после всех
+    if (linked_cells_.empty()) {
+        order_ = sheet_.TakeOrderAfterAll();
+        return false;
+    }
+
+    for (Cell* cell : referenced) {
+        // Ячейку без связей можно поставить перед всеми
+        if (cell->order_ > order_ && cell->linked_cells_.empty() && cell->referenced_cells_.empty()) {
+            cell->order_ = sheet_.TakeOrderBeforeAll();
+        }
+    }
+
+    for (Cell* cell : referenced) {
+        if (cell->order_ > order_ && ReorderBeforeThis(cell)) {
             return true;
         }
+    }
 
-        visited.insert(current);  
-        to_visit.pop();
+    return false;
+}
+
+// Ищет цикл в графе, где ссылки ячеек cells заменены на new_references, а
+// у остальных ячеек остались прежними. Новый цикл обязательно проходит через
+// одну из ячеек пакета, поэтому достаточно одного обхода в глубину от них по
+// ссылкам: цикл есть тогда и только тогда, когда обход встречает ячейку,
+// которая ещё лежит на текущем пути (нетривиальную компоненту сильной связности).
+bool Cell::HasCycle(const std::vector<Cell*>& cells,
+                    const std::vector<std::vector<Cell*>>& new_references) {
+    if (cells.empty()) {
+        return false;
+    }
 
-        for (const Cell* reference_cell : current->referenced_cells_) {
-            if (visited.find(reference_cell) == visited.end()) {
-                to_visit.push(reference_cell);
+    Sheet& sheet = cells.front()->sheet_;
+    std::unordered_map<const Cell*, const std::vector<Cell*>*> batch;
+    for (size_t i = 0; i < cells.size(); ++i) {
+        batch[cells[i]] = &new_references[i];
+    }
+
+    // Ячейка на текущем пути помечена on_path, полностью обойдённая - done
+    const std::uint64_t on_path = sheet.NextVisitEpoch();
+    const std::uint64_t done = sheet.NextVisitEpoch();
+
+    struct Frame {
+        Cell* cell;
+        const std::vector<Cell*>* batch_references;
+        size_t next_batch_reference;
+        std::set<Cell*>::const_iterator next, end;
+
+        Cell* Next() {
+            if (batch_references) {
+                return next_batch_reference < batch_references->size()
+                    ? (*batch_references)[next_batch_reference++] : nullptr;
+            }
+            return next != end ? *next++ : nullptr;
+        }
+    };
+
+    const auto make_frame = [&batch, on_path](Cell* cell) {
+        cell->visit_epoch_ = on_path;
+        const auto it = batch.find(cell);
+        return Frame{cell, it == batch.end() ? nullptr : it->second, 0,
+                     cell->referenced_cells_.begin(), cell->referenced_cells_.end()};
+    };
+
+    std::vector<Frame> path;
+    for (Cell* root : cells) {
+        if (root->visit_epoch_ == done) {
+            continue;
+        }
+
+        path.push_back(make_frame(root));
+        while (!path.empty()) {
+            Cell* next = path.back().Next();
+            if (!next) {
+                path.back().cell->visit_epoch_ = done;
+                path.pop_back();
+            } else if (next->visit_epoch_ == on_path) {
+                return true;
+            } else if (next->visit_epoch_ != done) {
+                path.push_back(make_frame(next));
             }
         }
     }
@@ -132,6 +401,72 @@ bool Cell::IsCircularDependency(const Impl& new_impl) {
     return false;
 }
 
+// Обрабатывает ссылку на ячейку referenced с бОльшим номером. Возвращает
+// true, если текущая ячейка достижима из referenced по зависимым, то есть
+// ссылка создаёт цикл; иначе переназначает номера затронутого участка.
+bool Cell::ReorderBeforeThis(Cell* referenced) {
+    std::vector<Cell*> forward;
+    CollectOrderRegion(this, referenced->order_, /* forward = */ true, forward);
+    if (referenced->visit_epoch_ == visit_epoch_) {
+        return true;
+    }
+
+    std::vector<Cell*> backward;
+    CollectOrderRegion(referenced, order_, /* forward = */ false, backward);
+
+    const auto by_order = [](const Cell* lhs, const Cell* rhs) {
+        return lhs->order_ < rhs->order_;
+    };
+    std::sort(forward.begin(), forward.end(), by_order);
+    std::sort(backward.begin(), backward.end(), by_order);
+
+    std::vector<std::int64_t> orders;
+    orders.reserve(forward.size() + backward.size());
+    for (const Cell* cell : backward) {
+        orders.push_back(cell->order_);
+    }
+    for (const Cell* cell : forward) {
+        orders.push_back(cell->order_);
+    }
+    std::sort(orders.begin(), orders.end());
+
+    // Всё, от чего зависит referenced, встаёт раньше всего, что зависит
+    // от текущей ячейки, с сохранением порядка внутри каждой группы
+    auto order = orders.begin();
+    for (Cell* cell : backward) {
+        cell->order_ = *order++;
+    }
+    for (Cell* cell : forward) {
+        cell->order_ = *order++;
+    }
+
+    return false;
+}
+
+// Собирает ячейки, достижимые из start по зависимым с номерами не больше
+// bound (forward) или по ссылкам с номерами больше bound (!forward).
+// Посещённые ячейки помечаются номером нового обхода.
+void Cell::CollectOrderRegion(Cell* start, std::int64_t bound, bool forward,
+                              std::vector<Cell*>& region) const {
+    const std::uint64_t epoch = sheet_.NextVisitEpoch();
+    std::vector<Cell*> to_visit{start};
+    start->visit_epoch_ = epoch;
+
+    while (!to_visit.empty()) {
+        Cell* current = to_visit.back();
+        to_visit.pop_back();
+        region.push_back(current);
+
+        for (Cell* next : forward ? current->linked_cells_ : current->referenced_cells_) {
+            const bool in_region = forward ? next->order_ <= bound : next->order_ > bound;
+            if (next->visit_epoch_ != epoch && in_region) {
+                next->visit_epoch_ = epoch;
+                to_visit.push_back(next);
+            }
+        }
+    }
+}
+
 void Cell::ClearCellInfo() {
     for(const auto& referenced_cell : referenced_cells_) {
         referenced_cell->linked_cells_.erase(this);
@@ -139,79 +474,198 @@ void Cell::ClearCellInfo() {
     referenced_cells_.clear();
 }
 
-void Cell::UpdateLinkedAndReferencedContainers() {
-    const auto pos_ref_cells = GetReferencedCells();
-
-    for(size_t i = 0; i < pos_ref_cells.size(); ++i) {
-        Cell* referenced_cell = sheet_.GetConcreteCell(pos_ref_cells[i]);
-
+void Cell::UpdateLinkedAndReferencedContainers(const std::vector<Cell*>& referenced) {
+    for(Cell* referenced_cell : referenced) {
         referenced_cells_.insert(referenced_cell);
         referenced_cell->linked_cells_.insert(this);
     }
 }
 
 void Cell::InvalidateCacheRecursive() {
-    if(const FormulaImpl* formula = dynamic_cast<FormulaImpl*>(impl_.get())) {
+    InvalidateCaches(sheet_, {this});
+}
 
-        if(formula->IsValidCache()) {
-            formula->InvalidateCache();
-        }  
+void Cell::InvalidateCaches(Sheet& sheet, const std::vector<Cell*>& cells) {
+    // Каждая зависимая ячейка посещается один раз за обход, даже если до неё
+    // ведёт много путей или она зависит от нескольких изменённых ячеек
+    const std::uint64_t epoch = sheet.NextVisitEpoch();
+    std::vector<Cell*> to_visit;
+    for(Cell* cell : cells) {
+        if(cell->visit_epoch_ != epoch) {
+            cell->visit_epoch_ = epoch;
+            to_visit.push_back(cell);
+        }
     }
 
-    for(const auto& linked_cell : linked_cells_) {
-        linked_cell->InvalidateCacheRecursive();
+    while(!to_visit.empty()) {
+        Cell* current = to_visit.back();
+        to_visit.pop_back();
+
+        current->impl_->InvalidateCache();
+
+        for(Cell* linked_cell : current->linked_cells_) {
+            if(linked_cell->visit_epoch_ != epoch) {
+                linked_cell->visit_epoch_ = epoch;
+                to_visit.push_back(linked_cell);
+            }
+        }
     }
 }
 
-//_______Cell::Impl_______
-Cell::Value Cell::Impl::GetValue() const {
-    return value_; 
+bool Cell::HasDirtyReferences() const {
+    return std::any_of(referenced_cells_.begin(), referenced_cells_.end(), [](const Cell* cell) {
+        return cell->IsDirty();
+    });
 }
 
-std::string Cell::Impl::GetText() const {
-    return text_;
+// Вычисляет все грязные ячейки, от которых зависит текущая, в порядке
+// зависимостей. Обход идёт по явному стеку, а каждая формула при вычислении
+// находит свои ссылки уже посчитанными, поэтому глубина рекурсии не зависит
+// от длины цепочки.
+void Cell::EvaluateDirtyReferences() const {
+    const std::uint64_t epoch = sheet_.NextVisitEpoch();
+    std::vector<std::pair<const Cell*, std::set<Cell*>::const_iterator>> path;
+    path.emplace_back(this, referenced_cells_.begin());
+
+    while(!path.empty()) {
+        auto& [cell, next] = path.back();
+
+        if(next == cell->referenced_cells_.end()) {
+            // Все ссылки ячейки посчитаны - можно считать её саму
+            cell->impl_->Evaluate();
+            path.pop_back();
+            continue;
+        }
+
+        Cell* referenced_cell = *next++;
+        if(referenced_cell->visit_epoch_ != epoch && referenced_cell->IsDirty()) {
+            referenced_cell->visit_epoch_ = epoch;
+            path.emplace_back(referenced_cell, referenced_cell->referenced_cells_.begin());
+        }
+    }
+}
+
+//_______Cell::Content_______
+Cell::Content::Content() = default;
+
+Cell::Content::Content(std::unique_ptr<Impl> impl)
+    : impl_(std::move(impl)) {
+}
+
+Cell::Content::Content(Content&& other) noexcept = default;
+
+Cell::Content& Cell::Content::operator=(Content&& other) noexcept = default;
+
+Cell::Content::~Content() = default;
+
+std::vector<Position> Cell::Content::GetReferencedCells() const {
+    return impl_->GetReferencedCells();
+}
+
+std::vector<Range> Cell::Content::GetReferencedRanges() const {
+    return impl_->GetReferencedRanges();
+}
+
+bool Cell::Content::IsFormula() const {
+    return impl_->IsFormula();
+}
+
+//_______Cell::Impl_______
+const FormulaInterface::Value& Cell::Impl::Evaluate() const {
+    return *numeric_;
 }
 
 std::vector<Position> Cell::Impl::GetReferencedCells() const {
     return {};
 }
 
-//_______Cell::TextImpl_______
-Cell::TextImpl::TextImpl(const std::string& text) {
-    text_ = text;
-    value_ = text[0] == ESCAPE_SIGN ? text.substr(1) : text;
+std::vector<Range> Cell::Impl::GetReferencedRanges() const {
+    return {};
 }
 
+const FormulaInterface* Cell::Impl::GetFormula() const {
+    return nullptr;
+}
 
-//_______Cell::FormulaImpl_______
-Cell::FormulaImpl::FormulaImpl(const std::string& formula, const SheetInterface& sheet) 
-    : sheet_(sheet) {
+void Cell::Impl::InvalidateCache() const {
+}
 
-    auto expr = formula.substr(1);
-    formula_ = ParseFormula(expr);
-    text_ = FORMULA_SIGN + formula_->GetExpression();
+bool Cell::Impl::IsFormula() const {
+    return is_formula_;
 }
 
-bool Cell::FormulaImpl::IsValidCache() const {
-    return cache_.has_value();
+bool Cell::Impl::IsDirty() const {
+    return !numeric_;
 }
 
-void Cell::FormulaImpl::InvalidateCache() const {
-    cache_.reset();
+std::string_view Cell::Impl::GetTextView() const {
+    return text_;
 }
 
-Cell::Value Cell::FormulaImpl::GetValue() const {
-    if(!cache_) {
-        cache_ = formula_->Evaluate(sheet_);
+std::string_view Cell::Impl::GetValueTextView() const {
+    return std::string_view(text_).substr(value_offset_);
+}
+
+const FormulaInterface::Value* Cell::Impl::GetCachedNumericValue() const {
+    return numeric_ ? &*numeric_ : nullptr;
+}
+
+void Cell::Impl::SetCachedNumericValue(const FormulaInterface::Value& value) const {
+    numeric_ = value;
+}
+
+//_______Cell::TextImpl_______
+Cell::TextImpl::TextImpl(std::string text) {
+    text_ = std::move(text);
+    value_offset_ = text_[0] == ESCAPE_SIGN ? 1 : 0;
+
+    const std::string_view value = GetValueTextView();
+    const auto number = value.empty() ? 0.0 : ParseNumber(value);
+    if(number) {
+        numeric_ = *number;
+    } else {
+        numeric_ = FormulaError(FormulaError::Category::Value);
     }
+}
+
+//_______Cell::FormulaImpl_______
+Cell::FormulaImpl::FormulaImpl(std::string_view formula, Position pos, Sheet& sheet) 
+    : sheet_(sheet) {
 
-    if(std::holds_alternative<double>(cache_.value())) {
-        return std::get<double>(cache_.value());
+    formula_ = sheet.GetFormulaPool().Parse(formula.substr(1), pos);
+    text_ = FORMULA_SIGN + formula_->GetExpression();
+    is_formula_ = true;
+    numeric_.reset();
+}
+
+Cell::FormulaImpl::FormulaImpl(std::string text, std::unique_ptr<FormulaInterface> formula,
+                               const SheetInterface& sheet)
+    : sheet_(sheet)
+    , formula_(std::move(formula)) {
+    text_ = std::move(text);
+    is_formula_ = true;
+    numeric_.reset();
+}
+
+const FormulaInterface::Value& Cell::FormulaImpl::Evaluate() const {
+    if(!numeric_) {
+        numeric_ = formula_->Evaluate(sheet_);
     }
+    return *numeric_;
+}
 
-    return std::get<FormulaError>(cache_.value());
+void Cell::FormulaImpl::InvalidateCache() const {
+    numeric_.reset();
 }
 
 std::vector<Position> Cell::FormulaImpl::GetReferencedCells() const {
     return formula_->GetReferencedCells();
 }
+
+std::vector<Range> Cell::FormulaImpl::GetReferencedRanges() const {
+    return formula_->GetReferencedRanges();
+}
+
+const FormulaInterface* Cell::FormulaImpl::GetFormula() const {
+    return formula_.get();
+}
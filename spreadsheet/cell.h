@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <set>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 #include "common.h"
 #include "formula.h"
@@ -9,34 +14,139 @@
 class Sheet;
 
 class Cell : public CellInterface {
+    class Impl;
+
 public:
+    // Разобранное, но ещё не установленное содержимое ячейки. Позволяет
+    // сначала проверить пакет изменений целиком, а потом применить его.
+    class Content {
+    public:
+        // Пустое содержимое оставляет ячейке прежнее, см. SetMany
+        Content();
+        Content(Content&& other) noexcept;
+        Content& operator=(Content&& other) noexcept;
+        ~Content();
+
+        std::vector<Position> GetReferencedCells() const;
+        std::vector<Range> GetReferencedRanges() const;
+        bool IsFormula() const;
+
+    private:
+        friend class Cell;
+
+        explicit Content(std::unique_ptr<Impl> impl);
+
+        std::unique_ptr<Impl> impl_;
+    };
+
     Cell();
     ~Cell();
 
     Cell(Sheet& sheet);
 
-    void Set(std::string text);
+    // pos - позиция ячейки в листе, от неё отсчитываются ссылки формулы
+    void Set(std::string text, Position pos);
+    // Содержимое не должно содержать областей: зависимости от них
+    // устанавливает лист через SetMany
+    void Set(Content content);
     void Clear();
 
+    // Бросает FormulaException, если текст - синтаксически некорректная формула.
+    // Формула разбирается через общие формулы листа, см. FormulaPool.
+    static Content Parse(std::string text, Position pos, Sheet& sheet);
+    // То же без промежуточной строки: формула разбирается прямо из text, а
+    // копия создаётся только для текста ячейки
+    static Content Parse(std::string_view text, Position pos, Sheet& sheet);
+    // Содержимое из уже разобранной формулы, text - её текст со знаком '='
+    static Content FromFormula(std::string text, std::unique_ptr<FormulaInterface> formula,
+                               Sheet& sheet);
+
+    // Устанавливает содержимое сразу нескольким ячейкам листа. references[i] -
+    // ячейки, от которых будет зависеть cells[i]: те, на которые ссылается
+    // содержимое, и формулы внутри его областей. Пустое Content оставляет
+    // ячейке прежнее содержимое и заменяет только её ссылки. Кеши
+    // range_dependents - формул, области которых задевает пакет, -
+    // сбрасываются вместе с кешами ячеек пакета. Циклы ищутся одним обходом
+    // объединённого графа, кеши сбрасываются одним проходом. Если пакет
+    // создаёт цикл, бросается CircularDependencyException и ни одна ячейка
+    // не изменяется.
+    static void SetMany(const std::vector<Cell*>& cells, std::vector<Content> contents,
+                        const std::vector<std::vector<Cell*>>& references,
+                        const std::vector<Cell*>& range_dependents);
+
     Value GetValue() const override;
     std::string GetText() const override;
+    // Ячейки областей формулы сюда не входят, см. GetReferencedRanges
     std::vector<Position> GetReferencedCells() const override;
+    std::vector<Range> GetReferencedRanges() const;
+
+    // Невиртуальные методы доступа без копирования текста, для вычисления
+    // формул и печати. Формула при необходимости вычисляется.
+
+    // Значение ячейки как аргумента формулы: пустая ячейка и пустой текст
+    // дают ноль, текст - число, разобранное один раз при его установке, или
+    // ошибку #VALUE!, формула - своё значение без преобразования к тексту
+    FormulaInterface::Value GetNumericValue() const;
+    // То же значение, если это число, и nullopt, если ошибка
+    std::optional<double> TryGetNumber() const;
+    // Значение ячейки внутри области, переданной функции: как
+    // GetNumericValue, но пустая ячейка и текст, который не является числом,
+    // дают nullopt и пропускаются
+    std::optional<FormulaInterface::Value> GetRangeValue() const;
+
+    // Видимое значение, как GetValue, но текст не копируется и живёт, пока
+    // не изменится ячейка
+    using ValueView = std::variant<std::string_view, double, FormulaError>;
+    ValueView GetValueView() const;
+
+    std::string_view GetTextView() const;
+    bool IsEmpty() const;
+
+    // Формула ячейки или nullptr, если ячейка не содержит формулу
+    const FormulaInterface* GetFormula() const;
 
     bool IsReferenced() const;
+    // Формула, значение которой ещё не вычислено после последнего изменения
+    bool IsDirty() const;
+
+    // Вычисляет формулы ячеек [first, last) - идущих подряд сверху вниз
+    // ячеек одного столбца с общим деревом формулы (см. GetColumnKey) - одним
+    // проходом, как EvaluateColumn. Ссылки ячеек уже должны быть вычислены.
+    static void EvaluateColumn(std::vector<Cell*>::const_iterator first,
+                               std::vector<Cell*>::const_iterator last);
+
+    // Разбивает грязные ячейки на уровни: ячейки одного уровня не зависят
+    // друг от друга, а все их грязные ссылки лежат на предыдущих уровнях.
+    // Уровни можно вычислять по очереди, а ячейки внутри уровня - параллельно.
+    static std::vector<std::vector<Cell*>> SplitIntoLevels(std::vector<Cell*> dirty_cells);
 
 private:
     std::set<Cell*> linked_cells_;
     std::set<Cell*> referenced_cells_;
     Sheet& sheet_;
+    // Номер последнего обхода графа, в котором ячейка была посещена
+    std::uint64_t visit_epoch_ = 0;
+    // Топологический номер: ячейка идёт после всех ячеек, на которые
+    // ссылается. Поддерживается при каждом изменении ссылок.
+    std::int64_t order_;
 
-    class Impl;
     class EmptyImpl;
     class TextImpl;
     class FormulaImpl;
     std::unique_ptr<Impl> impl_;
     
-    bool IsCircularDependency(const Impl& new_impl);
+    bool IsCircularDependency(const std::vector<Cell*>& referenced);
+    std::vector<Cell*> GetOrCreateReferences(const Impl& impl);
+    bool OrderAfter(const std::vector<Cell*>& referenced);
+    static bool HasCycle(const std::vector<Cell*>& cells,
+                         const std::vector<std::vector<Cell*>>& new_references);
+    bool ReorderBeforeThis(Cell* referenced);
+    void CollectOrderRegion(Cell* start, std::int64_t bound, bool forward,
+                            std::vector<Cell*>& region) const;
     void ClearCellInfo();
-    void UpdateLinkedAndReferencedContainers();
+    void UpdateLinkedAndReferencedContainers(const std::vector<Cell*>& referenced);
     void InvalidateCacheRecursive();
+    static void InvalidateCaches(Sheet& sheet, const std::vector<Cell*>& cells);
+    bool HasDirtyReferences() const;
+    void EvaluateDirtyReferences() const;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <algorithm>
+
+#include "cell_storage.h"
+
+CellStorage::CellStorage() = default;
+
+CellStorage::~CellStorage() = default;
+
+Cell* CellStorage::Find(Position pos) const {
+    const auto* tile = tiles_.Find(TileKey(pos.row >> TILE_SHIFT, pos.col >> TILE_SHIFT));
+    if (!tile) {
+        return nullptr;
+    }
+
+    return (*tile)->Find(LocalOffset(pos));
+}
+
+void CellStorage::FindInColumn(Position first, size_t count, const Cell** cells) const {
+    const int tile_col = first.col >> TILE_SHIFT;
+    const int local_col = first.col & (TILE_SIZE - 1);
+
+    for (size_t i = 0; i < count;) {
+        const int row = first.row + static_cast<int>(i);
+        const int local_row = row & (TILE_SIZE - 1);
+        const size_t band_size = std::min<size_t>(TILE_SIZE - local_row, count - i);
+
+        const auto* tile = tiles_.Find(TileKey(row >> TILE_SHIFT, tile_col));
+        for (size_t j = 0; j < band_size; ++j) {
+            cells[i + j] = tile ? (*tile)->Find(((local_row + static_cast<int>(j)) << TILE_SHIFT) | local_col) : nullptr;
+        }
+        i += band_size;
+    }
+}
+
+Cell& CellStorage::Insert(Position pos, std::unique_ptr<Cell> cell) {
+    auto& tile = tiles_[TileKey(pos.row >> TILE_SHIFT, pos.col >> TILE_SHIFT)];
+    if (!tile) {
+        tile = std::make_unique<Tile>();
+    }
+
+    Cell& result = *cell;
+    tile->Insert(LocalOffset(pos), std::move(cell));
+    ++size_;
+
+    return result;
+}
+
+void CellStorage::Erase(Position pos) {
+    const PositionKey key = TileKey(pos.row >> TILE_SHIFT, pos.col >> TILE_SHIFT);
+    auto* tile = tiles_.Find(key);
+    if (!tile || !(*tile)->Find(LocalOffset(pos))) {
+        return;
+    }
+
+    (*tile)->Erase(LocalOffset(pos));
+    --size_;
+
+    if ((*tile)->Count() == 0) {
+        tiles_.Erase(key);
+    }
+}
+
+void CellStorage::Clear() {
+    tiles_ = FlatHashMap<std::unique_ptr<Tile>>{};
+    size_ = 0;
+}
+
+size_t CellStorage::Size() const {
+    return size_;
+}
+
+std::vector<PositionKey> CellStorage::SortedTileKeys() const {
+    std::vector<PositionKey> keys;
+    keys.reserve(tiles_.Size());
+    tiles_.ForEach([&keys](PositionKey key, const std::unique_ptr<Tile>&) {
+        keys.push_back(key);
+    });
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+PositionKey CellStorage::TileKey(int tile_row, int tile_col) {
+    return PackPosition({tile_row, tile_col});
+}
+
+int CellStorage::LocalOffset(Position pos) {
+    return ((pos.row & (TILE_SIZE - 1)) << TILE_SHIFT) | (pos.col & (TILE_SIZE - 1));
+}
+
+//_______CellStorage::Tile_______
+Cell* CellStorage::Tile::Find(int offset) const {
+    if (IsDense()) {
+        return dense_[offset].get();
+    }
+
+    const auto it = LowerBound(offset);
+    if (it == sparse_.end() || it->first != offset) {
+        return nullptr;
+    }
+
+    return it->second.get();
+}
+
+void CellStorage::Tile::Insert(int offset, std::unique_ptr<Cell> cell) {
+    ++count_;
+
+    if (IsDense()) {
+        dense_[offset] = std::move(cell);
+        return;
+    }
+
+    sparse_.emplace(LowerBound(offset), static_cast<std::uint16_t>(offset), std::move(cell));
+
+    if (count_ > DENSE_THRESHOLD) {
+        MakeDense();
+    }
+}
+
+void CellStorage::Tile::Erase(int offset) {
+    --count_;
+
+    if (IsDense()) {
+        dense_[offset].reset();
+
+        if (count_ < SPARSE_THRESHOLD) {
+            MakeSparse();
+        }
+        return;
+    }
+
+    sparse_.erase(LowerBound(offset));
+}
+
+int CellStorage::Tile::Count() const {
+    return count_;
+}
+
+bool CellStorage::Tile::IsDense() const {
+    return !dense_.empty();
+}
+
+std::vector<CellStorage::Tile::SparseEntry>::const_iterator CellStorage::Tile::LowerBound(int offset) const {
+    return std::lower_bound(sparse_.begin(), sparse_.end(), offset,
+                            [](const SparseEntry& entry, int value) {
+                                return entry.first < value;
+                            });
+}
+
+void CellStorage::Tile::MakeDense() {
+    dense_.resize(TILE_AREA);
+    for (auto& [offset, cell] : sparse_) {
+        dense_[offset] = std::move(cell);
+    }
+
+    sparse_.clear();
+    sparse_.shrink_to_fit();
+}
+
+void CellStorage::Tile::MakeSparse() {
+    sparse_.reserve(count_);
+    for (int offset = 0; offset < TILE_AREA; ++offset) {
+        if (dense_[offset]) {
+            sparse_.emplace_back(static_cast<std::uint16_t>(offset), std::move(dense_[offset]));
+        }
+    }
+
+    dense_.clear();
+    dense_.shrink_to_fit();
+}
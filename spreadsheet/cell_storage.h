@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cell.h"
+#include "common.h"
+#include "flat_hash_map.h"
+
+// Хранилище ячеек листа. Лист разбит на тайлы TILE_SIZE x TILE_SIZE, тайл
+// адресуется упакованной позицией (row >> TILE_SHIFT, col >> TILE_SHIFT) в
+// хеш-таблице с открытой адресацией. Внутри тайла ячейки
+// лежат построчно, поэтому обход строки идёт по непрерывной памяти.
+// Малозаполненный тайл хранит отсортированный массив (смещение, ячейка),
+// заполненный - плотный массив на все позиции тайла.
+class CellStorage {
+public:
+    static const int TILE_SHIFT = 6;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+    static const int TILE_AREA = TILE_SIZE * TILE_SIZE;
+
+    CellStorage();
+    ~CellStorage();
+
+    Cell* Find(Position pos) const;
+    // Записывает в cells[i] ячейку на i строк ниже first или nullptr, если
+    // её нет. Тайл ищется один раз на каждые TILE_SIZE строк.
+    void FindInColumn(Position first, size_t count, const Cell** cells) const;
+    Cell& Insert(Position pos, std::unique_ptr<Cell> cell);
+    void Erase(Position pos);
+    void Clear();
+
+    size_t Size() const;
+
+    // Ключ тайла, содержащего позицию с тайловыми координатами
+    // (tile_row, tile_col), и смещение позиции внутри её тайла
+    static PositionKey TileKey(int tile_row, int tile_col);
+    static int LocalOffset(Position pos);
+
+    // Вызывает func(pos, cell) для всех ячеек хранилища в произвольном порядке
+    template <typename Func>
+    void ForEach(Func func) const;
+
+    // Вызывает func(col, cell) для всех ячеек строки row в столбцах
+    // [col_begin, col_end) по возрастанию столбца.
+    template <typename Func>
+    void ForEachInRow(int row, int col_begin, int col_end, Func func) const;
+
+    // Ключи всех тайлов по возрастанию: строка тайла лежит в старших битах
+    // ключа, поэтому тайлы одной полосы строк идут подряд по возрастанию
+    // столбца. Список верен, пока тайлы не добавляются и не удаляются.
+    std::vector<PositionKey> SortedTileKeys() const;
+
+    // Вызывает func(pos, cell) для всех ячеек строк [row_begin, row_end)
+    // построчно, по возрастанию строки, а внутри строки - столбца. tile_keys -
+    // результат SortedTileKeys, полосы строк ищутся в нём двоичным поиском,
+    // так что обходы разных строк сортируют ключи один раз на всех.
+    template <typename Func>
+    void ForEachOrdered(const std::vector<PositionKey>& tile_keys, int row_begin, int row_end, Func func) const;
+
+    // Вызывает func(pos, cell) для всех ячеек области range в произвольном
+    // порядке. Обходятся тайлы, пересекающие область, или все тайлы
+    // хранилища, если их меньше.
+    template <typename Func>
+    void ForEachInRange(Range range, Func func) const;
+
+private:
+    class Tile {
+    public:
+        Cell* Find(int offset) const;
+        void Insert(int offset, std::unique_ptr<Cell> cell);
+        void Erase(int offset);
+
+        int Count() const;
+
+        template <typename Func>
+        void ForEach(Func func) const;
+
+        template <typename Func>
+        void ForEachInRow(int local_row, int local_begin, int local_end, Func func) const;
+
+    private:
+        // Пороги переключения представления разнесены, чтобы тайл на границе
+        // не перестраивался при каждой вставке/удалении.
+        static const int DENSE_THRESHOLD = TILE_AREA / 8;
+        static const int SPARSE_THRESHOLD = TILE_AREA / 32;
+
+        using SparseEntry = std::pair<std::uint16_t, std::unique_ptr<Cell>>;
+
+        std::vector<std::unique_ptr<Cell>> dense_;
+        std::vector<SparseEntry> sparse_;
+        int count_ = 0;
+
+        bool IsDense() const;
+        std::vector<SparseEntry>::const_iterator LowerBound(int offset) const;
+        void MakeDense();
+        void MakeSparse();
+    };
+
+    FlatHashMap<std::unique_ptr<Tile>> tiles_;
+    size_t size_ = 0;
+};
+
+template <typename Func>
+void CellStorage::ForEach(Func func) const {
+    tiles_.ForEach([&func](PositionKey key, const std::unique_ptr<Tile>& tile) {
+        const Position tile_pos = UnpackPosition(key);
+        tile->ForEach([&](int offset, Cell& cell) {
+            func(Position{(tile_pos.row << TILE_SHIFT) + (offset >> TILE_SHIFT),
+                          (tile_pos.col << TILE_SHIFT) + (offset & (TILE_SIZE - 1))},
+                 cell);
+        });
+    });
+}
+
+template <typename Func>
+void CellStorage::ForEachInRow(int row, int col_begin, int col_end, Func func) const {
+    const int tile_row = row >> TILE_SHIFT;
+    const int local_row = row & (TILE_SIZE - 1);
+
+    for (int tile_col = col_begin >> TILE_SHIFT; tile_col <= (col_end - 1) >> TILE_SHIFT; ++tile_col) {
+        const auto* tile = tiles_.Find(TileKey(tile_row, tile_col));
+        if (!tile) {
+            continue;
+        }
+
+        const int tile_begin = tile_col << TILE_SHIFT;
+        const int local_begin = std::max(col_begin - tile_begin, 0);
+        const int local_end = std::min(col_end - tile_begin, TILE_SIZE);
+
+        (*tile)->ForEachInRow(local_row, local_begin, local_end, [&](int local_col, const Cell& cell) {
+            func(tile_begin + local_col, cell);
+        });
+    }
+}
+
+template <typename Func>
+void CellStorage::ForEachOrdered(const std::vector<PositionKey>& tile_keys, int row_begin, int row_end,
+                                 Func func) const {
+    if (row_begin >= row_end) {
+        return;
+    }
+
+    const int tile_row_begin = row_begin >> TILE_SHIFT;
+    const int tile_row_end = ((row_end - 1) >> TILE_SHIFT) + 1;
+    const auto keys_begin = std::lower_bound(tile_keys.begin(), tile_keys.end(), TileKey(tile_row_begin, 0));
+    const auto keys_end = std::lower_bound(keys_begin, tile_keys.end(), TileKey(tile_row_end, 0));
+
+    std::vector<std::pair<int, const Tile*>> band;
+    for (auto begin = keys_begin, end = keys_begin; begin != keys_end; begin = end) {
+        const int tile_row = UnpackPosition(*begin).row;
+
+        band.clear();
+        for (end = begin; end != keys_end && UnpackPosition(*end).row == tile_row; ++end) {
+            band.emplace_back(UnpackPosition(*end).col << TILE_SHIFT, tiles_.Find(*end)->get());
+        }
+
+        const int band_begin = tile_row << TILE_SHIFT;
+        for (int row = std::max(band_begin, row_begin); row < std::min(band_begin + TILE_SIZE, row_end); ++row) {
+            const int local_row = row - band_begin;
+            for (const auto& [tile_begin, tile] : band) {
+                tile->ForEachInRow(local_row, 0, TILE_SIZE, [&](int local_col, const Cell& cell) {
+                    func(Position{row, tile_begin + local_col}, cell);
+                });
+            }
+        }
+    }
+}
+
+template <typename Func>
+void CellStorage::ForEachInRange(Range range, Func func) const {
+    const auto visit_tile = [&](int tile_row, int tile_col, const Tile& tile) {
+        const Position tile_begin{tile_row << TILE_SHIFT, tile_col << TILE_SHIFT};
+        const Range tile_range{tile_begin, {tile_begin.row + TILE_SIZE - 1, tile_begin.col + TILE_SIZE - 1}};
+        if (range.Contains(tile_range.first) && range.Contains(tile_range.last)) {
+            tile.ForEach([&](int offset, Cell& cell) {
+                func(Position{tile_begin.row + (offset >> TILE_SHIFT), tile_begin.col + (offset & (TILE_SIZE - 1))},
+                     cell);
+            });
+            return;
+        }
+
+        // Тайл задет частично: обходятся только столбцы области в её строках,
+        // так что узкая область не перебирает тайл целиком
+        const int local_begin = std::max(range.first.col - tile_begin.col, 0);
+        const int local_end = std::min(range.last.col - tile_begin.col + 1, TILE_SIZE);
+        const int row_begin = std::max(range.first.row, tile_begin.row);
+        const int row_end = std::min(range.last.row + 1, tile_begin.row + TILE_SIZE);
+        for (int row = row_begin; row < row_end; ++row) {
+            tile.ForEachInRow(row - tile_begin.row, local_begin, local_end, [&](int local_col, Cell& cell) {
+                func(Position{row, tile_begin.col + local_col}, cell);
+            });
+        }
+    };
+
+    const int tile_row_begin = range.first.row >> TILE_SHIFT;
+    const int tile_row_end = (range.last.row >> TILE_SHIFT) + 1;
+    const int tile_col_begin = range.first.col >> TILE_SHIFT;
+    const int tile_col_end = (range.last.col >> TILE_SHIFT) + 1;
+
+    const size_t range_tiles = static_cast<size_t>(tile_row_end - tile_row_begin) * (tile_col_end - tile_col_begin);
+    if (range_tiles > tiles_.Size()) {
+        tiles_.ForEach([&](PositionKey key, const std::unique_ptr<Tile>& tile) {
+            const Position tile_pos = UnpackPosition(key);
+            if (tile_pos.row >= tile_row_begin && tile_pos.row < tile_row_end
+                && tile_pos.col >= tile_col_begin && tile_pos.col < tile_col_end) {
+                visit_tile(tile_pos.row, tile_pos.col, *tile);
+            }
+        });
+        return;
+    }
+
+    for (int tile_row = tile_row_begin; tile_row < tile_row_end; ++tile_row) {
+        for (int tile_col = tile_col_begin; tile_col < tile_col_end; ++tile_col) {
+            if (const auto* tile = tiles_.Find(TileKey(tile_row, tile_col))) {
+                visit_tile(tile_row, tile_col, **tile);
+            }
+        }
+    }
+}
+
+template <typename Func>
+void CellStorage::Tile::ForEach(Func func) const {
+    if (IsDense()) {
+        for (int offset = 0; offset < TILE_AREA; ++offset) {
+            if (dense_[offset]) {
+                func(offset, *dense_[offset]);
+            }
+        }
+        return;
+    }
+
+    for (const auto& [offset, cell] : sparse_) {
+        func(offset, *cell);
+    }
+}
+
+template <typename Func>
+void CellStorage::Tile::ForEachInRow(int local_row, int local_begin, int local_end, Func func) const {
+    const int row_offset = local_row << TILE_SHIFT;
+
+    if (IsDense()) {
+        for (int local_col = local_begin; local_col < local_end; ++local_col) {
+            if (Cell* cell = dense_[row_offset + local_col].get()) {
+                func(local_col, *cell);
+            }
+        }
+        return;
+    }
+
+    for (auto it = LowerBound(row_offset + local_begin);
+         it != sparse_.end() && it->first < row_offset + local_end; ++it) {
+        func(it->first - row_offset, *it->second);
+    }
+}
@@ -33,6 +33,23 @@ struct Size {
     bool operator==(Size rhs) const;
 };
 
+// Прямоугольная область листа от левой верхней ячейки first до правой нижней
+// ячейки last включительно. Записывается как "A1:B2".
+struct Range {
+    Position first;
+    Position last;
+
+    bool operator==(Range rhs) const;
+
+    bool IsValid() const;
+    bool Contains(Position pos) const;
+    Size GetSize() const;
+    std::string ToString() const;
+
+    // Для некорректной записи возвращает область с позициями Position::NONE
+    static Range FromString(std::string_view str);
+};
+
 // Описывает ошибки, которые могут возникнуть при вычислении формулы.
 class FormulaError {
 public:
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+// Позиция, упакованная в 32-битный ключ: строка в старших POSITION_KEY_BITS
+// битах, столбец в младших. MAX_ROWS и MAX_COLS равны 2^14, поэтому ключ
+// занимает 28 бит.
+using PositionKey = std::uint32_t;
+
+inline constexpr int POSITION_KEY_BITS = 14;
+
+inline PositionKey PackPosition(Position pos) {
+    return (static_cast<PositionKey>(pos.row) << POSITION_KEY_BITS) | static_cast<PositionKey>(pos.col);
+}
+
+inline Position UnpackPosition(PositionKey key) {
+    const PositionKey mask = (PositionKey{1} << POSITION_KEY_BITS) - 1;
+    return {static_cast<int>(key >> POSITION_KEY_BITS), static_cast<int>(key & mask)};
+}
+
+// Хеш-таблица с открытой адресацией и линейным пробированием для
+// целочисленных ключей. Все элементы лежат в одном массиве, вставка не
+// выделяет память под отдельные узлы. Удаление сдвигает следующие элементы
+// цепочки назад, поэтому "надгробия" не нужны.
+// Ключ EMPTY_KEY зарезервирован и не может быть вставлен.
+template <typename Value>
+class FlatHashMap {
+public:
+    static const std::uint32_t EMPTY_KEY = ~std::uint32_t{0};
+
+    Value* Find(std::uint32_t key);
+    const Value* Find(std::uint32_t key) const;
+
+    // Возвращает значение по ключу, вставляя Value{} при отсутствии
+    Value& operator[](std::uint32_t key);
+    bool Erase(std::uint32_t key);
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // Вызывает func(key, value) для всех элементов в порядке расположения в таблице
+    template <typename Func>
+    void ForEach(Func func) const;
+
+private:
+    struct Slot {
+        std::uint32_t key = EMPTY_KEY;
+        Value value{};
+    };
+
+    // Таблица расширяется при заполнении больше чем на 7/8
+    static const size_t MIN_CAPACITY = 16;
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    int shift_ = 32;
+
+    size_t IndexFor(std::uint32_t key) const;
+    size_t FindSlot(std::uint32_t key) const;
+    void Rehash(size_t capacity);
+};
+
+template <typename Value>
+Value* FlatHashMap<Value>::Find(std::uint32_t key) {
+    const size_t index = FindSlot(key);
+    return index == slots_.size() ? nullptr : &slots_[index].value;
+}
+
+template <typename Value>
+const Value* FlatHashMap<Value>::Find(std::uint32_t key) const {
+    const size_t index = FindSlot(key);
+    return index == slots_.size() ? nullptr : &slots_[index].value;
+}
+
+template <typename Value>
+Value& FlatHashMap<Value>::operator[](std::uint32_t key) {
+    if ((size_ + 1) * 8 > slots_.size() * 7) {
+        Rehash(slots_.empty() ? MIN_CAPACITY : slots_.size() * 2);
+    }
+
+    const size_t mask = slots_.size() - 1;
+    size_t index = IndexFor(key);
+    while (slots_[index].key != EMPTY_KEY) {
+        if (slots_[index].key == key) {
+            return slots_[index].value;
+        }
+        index = (index + 1) & mask;
+    }
+
+    slots_[index].key = key;
+    ++size_;
+
+    return slots_[index].value;
+}
+
+template <typename Value>
+bool FlatHashMap<Value>::Erase(std::uint32_t key) {
+    size_t hole = FindSlot(key);
+    if (hole == slots_.size()) {
+        return false;
+    }
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t index = (hole + 1) & mask; slots_[index].key != EMPTY_KEY; index = (index + 1) & mask) {
+        // Элемент можно перенести в дыру, если его исходная позиция
+        // не лежит циклически в интервале (hole, index]
+        const size_t home = IndexFor(slots_[index].key);
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            slots_[hole] = std::move(slots_[index]);
+            hole = index;
+        }
+    }
+
+    slots_[hole].key = EMPTY_KEY;
+    slots_[hole].value = Value{};
+    --size_;
+
+    return true;
+}
+
+template <typename Value>
+size_t FlatHashMap<Value>::Size() const {
+    return size_;
+}
+
+template <typename Value>
+bool FlatHashMap<Value>::Empty() const {
+    return size_ == 0;
+}
+
+template <typename Value>
+template <typename Func>
+void FlatHashMap<Value>::ForEach(Func func) const {
+    for (const Slot& slot : slots_) {
+        if (slot.key != EMPTY_KEY) {
+            func(slot.key, slot.value);
+        }
+    }
+}
+
+template <typename Value>
+size_t FlatHashMap<Value>::IndexFor(std::uint32_t key) const {
+    // Фибоначчиево хеширование: старшие биты произведения хорошо
+    // перемешаны даже для соседних ключей
+    return static_cast<size_t>((key * 0x9E3779B9u) >> shift_);
+}
+
+template <typename Value>
+size_t FlatHashMap<Value>::FindSlot(std::uint32_t key) const {
+    if (slots_.empty()) {
+        return 0;
+    }
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t index = IndexFor(key); slots_[index].key != EMPTY_KEY; index = (index + 1) & mask) {
+        if (slots_[index].key == key) {
+            return index;
+        }
+    }
+
+    return slots_.size();
+}
+
+template <typename Value>
+void FlatHashMap<Value>::Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+
+    shift_ = 32;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+        --shift_;
+    }
+
+    const size_t mask = capacity - 1;
+    for (Slot& slot : old_slots) {
+        if (slot.key == EMPTY_KEY) {
+            continue;
+        }
+
+        size_t index = IndexFor(slot.key);
+        while (slots_[index].key != EMPTY_KEY) {
+            index = (index + 1) & mask;
+        }
+        slots_[index] = std::move(slot);
+    }
+}
@@ -1,9 +1,12 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <charconv>
 #include <functional>
+#include <iterator>
 #include <iostream>
 #include <sstream>
+#include <tuple>
 
 #include "formula.h"
 #include "FormulaAST.h"
@@ -14,43 +17,49 @@ namespace {
 
 class Formula : public FormulaInterface {
 public:
-    explicit Formula(std::string expression);
+    Formula(std::shared_ptr<const FormulaAST> ast, Position origin);
 
     Value Evaluate(const SheetInterface& sheet) const override;
     std::string GetExpression() const override;
-    std::vector<Position> GetReferencedCells() const;
+    std::vector<Position> GetReferencedCells() const override;
+    std::vector<Range> GetReferencedRanges() const override;
+    void Serialize(std::string& out) const override;
+
+    const FormulaAST& GetAST() const;
+    Position GetOrigin() const;
 private:
-    FormulaAST ast_;
+    std::shared_ptr<const FormulaAST> ast_;
+    // Ссылки в ast_ хранятся смещениями от этой позиции
+    Position origin_;
 };
 
-//_______Formula_______
-Formula::Formula(std::string expression) try
-    : ast_(ParseFormulaAST(expression)) {
+FormulaAST ParseAST(std::string_view expression) try {
+    return ParseFormulaAST(expression);
 } catch(const std::exception& e) {
- std::throw_with_nested(FormulaException(e.what()));
+    std::throw_with_nested(FormulaException(e.what()));
 }
 
-FormulaInterface::Value Formula::Evaluate(const SheetInterface& sheet) const  {
-    ASTImpl::ArgCell functor(sheet);
+//_______Formula_______
+Formula::Formula(std::shared_ptr<const FormulaAST> ast, Position origin)
+    : ast_(std::move(ast))
+    , origin_(origin) {
+}
 
-    try {
-        return ast_.Execute(functor);
-    } catch(const FormulaError& err) {
-        return err;
-    }
+FormulaInterface::Value Formula::Evaluate(const SheetInterface& sheet) const  {
+    return ast_->Execute(ASTImpl::ArgCell(sheet, origin_));
 }
 
 std::string Formula::GetExpression() const {
     std::ostringstream out;
-    ast_.PrintFormula(out);
+    ast_->PrintFormula(out, origin_);
 
     return out.str();
 }
 
 std::vector<Position> Formula::GetReferencedCells() const {
     std::vector<Position> cells;
-    for (auto cell : ast_.GetReferencedCells()) {
-            cells.push_back(cell);
+    for (auto cell : ast_->GetReferencedCells()) {
+            cells.push_back(ASTImpl::Shift(cell, origin_));
     }
     
     std::sort(cells.begin(), cells.end());
@@ -58,8 +67,126 @@ std::vector<Position> Formula::GetReferencedCells() const {
 
     return cells;
 }
+
+std::vector<Range> Formula::GetReferencedRanges() const {
+    std::vector<Range> ranges;
+    for (auto range : ast_->GetReferencedRanges()) {
+        ranges.push_back(ASTImpl::Shift(range, origin_));
+    }
+
+    const auto as_tuple = [](Range range) {
+        return std::tuple(range.first, range.last);
+    };
+    std::sort(ranges.begin(), ranges.end(), [&as_tuple](Range lhs, Range rhs) {
+        return as_tuple(lhs) < as_tuple(rhs);
+    });
+    ranges.resize(std::unique(ranges.begin(), ranges.end()) - ranges.begin());
+
+    return ranges;
+}
+
+void Formula::Serialize(std::string& out) const {
+    ast_->Serialize(out, origin_);
+}
+
+const FormulaAST& Formula::GetAST() const {
+    return *ast_;
+}
+
+Position Formula::GetOrigin() const {
+    return origin_;
+}
 } // namespace
 
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression) {
-    return std::make_unique<Formula>(std::move(expression));
-}
\ No newline at end of file
+    return std::make_unique<Formula>(std::make_shared<const FormulaAST>(ParseAST(expression)), Position{0, 0});
+}
+
+std::unique_ptr<FormulaInterface> DeserializeFormula(std::string_view data) {
+    return std::make_unique<Formula>(std::make_shared<const FormulaAST>(DeserializeFormulaAST(data)), Position{0, 0});
+}
+
+ColumnKey GetColumnKey(const FormulaInterface& formula) {
+    if (const auto* concrete = dynamic_cast<const Formula*>(&formula)) {
+        return {&concrete->GetAST(), concrete->GetOrigin()};
+    }
+    return {};
+}
+
+void EvaluateColumn(const FormulaInterface& first, size_t count, const SheetInterface& sheet,
+                    FormulaInterface::Value* values) {
+    const auto& formula = dynamic_cast<const Formula&>(first);
+    formula.GetAST().ExecuteColumn(ASTImpl::ArgCell(sheet, formula.GetOrigin()), count, values);
+}
+
+//_______FormulaPool_______
+std::unique_ptr<FormulaInterface> FormulaPool::Parse(std::string_view expression, Position pos) {
+    return Share(ParseAST(expression), pos);
+}
+
+std::unique_ptr<FormulaInterface> FormulaPool::Deserialize(std::string_view data, Position pos) {
+    return Share(DeserializeFormulaAST(data), pos);
+}
+
+size_t FormulaPool::GetSharedCount() const {
+    return std::count_if(formulas_.begin(), formulas_.end(), [](const auto& entry) {
+        return !entry.second.expired();
+    });
+}
+
+std::unique_ptr<FormulaInterface> FormulaPool::Share(FormulaAST ast, Position pos) {
+    ast.MakeRelative(pos);
+    auto& shared = formulas_[ast.GetRelativeKey()];
+
+    auto shared_ast = shared.lock();
+    if (!shared_ast) {
+        shared_ast = std::make_shared<const FormulaAST>(std::move(ast));
+        shared = shared_ast;
+    }
+
+    // Деревья удалённых формул вычищаются, когда таблица вырастает вдвое
+    if (formulas_.size() >= sweep_size_) {
+        for (auto it = formulas_.begin(); it != formulas_.end();) {
+            it = it->second.expired() ? formulas_.erase(it) : std::next(it);
+        }
+        sweep_size_ = std::max(sweep_size_, formulas_.size() * 2);
+    }
+
+    return std::make_unique<Formula>(std::move(shared_ast), pos);
+}
+
+std::optional<double> ParseNumber(std::string_view text) {
+    std::string_view number = text;
+    while(!number.empty() && std::isspace(static_cast<unsigned char>(number.front()))) {
+        number.remove_prefix(1);
+    }
+
+    // from_chars не принимает '+', но принимает inf и nan
+    size_t first_digit = 0;
+    if(!number.empty() && number.front() == '+') {
+        number.remove_prefix(1);
+    } else if(!number.empty() && number.front() == '-') {
+        first_digit = 1;
+    }
+    if(first_digit >= number.size()
+       || !(std::isdigit(static_cast<unsigned char>(number[first_digit])) || number[first_digit] == '.')) {
+        return std::nullopt;
+    }
+
+    double result = 0;
+    const auto [end, error] = std::from_chars(number.data(), number.data() + number.size(), result);
+    if(error == std::errc::result_out_of_range) {
+        // Поток отвергает переполнение, но принимает потерю точности у нуля:
+        // в этих редких случаях решает он сам
+        std::istringstream in{std::string(text)};
+        if(!(in >> result) || !in.eof()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+    if(error != std::errc() || end != number.data() + number.size()) {
+        return std::nullopt;
+    }
+
+    return result;
+}
@@ -3,12 +3,19 @@
 #include "common.h"
 
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+class FormulaAST;
+
 // Формула, позволяющая вычислять и обновлять арифметическое выражение.
 // Поддерживаемые возможности:
 // * Простые бинарные операции и числа, скобки: 1+2*3, 2.5*(2+3.5/7)
 // * Значения ячеек в качестве переменных: A1+B2*C3
+// * Функции SUM, AVERAGE, MIN, MAX, COUNT от значений и областей: SUM(A1:B5,C1)
 // Ячейки, указанные в формуле, могут быть как формулами, так и текстом. Если это
 // текст, но он представляет число, тогда его нужно трактовать как число. Пустая
 // ячейка или ячейка с пустым текстом трактуется как число ноль.
@@ -34,8 +41,67 @@ public:
     // формулы. Список отсортирован по возрастанию и не содержит повторяющихся
     // ячеек.
     virtual std::vector<Position> GetReferencedCells() const = 0;
+
+    // Возвращает области, переданные функциям формулы, по возрастанию и без
+    // повторов. Их ячейки не входят в GetReferencedCells.
+    virtual std::vector<Range> GetReferencedRanges() const = 0;
+
+    // Дописывает в out разобранное представление формулы, из которого
+    // DeserializeFormula восстанавливает её без повторного разбора текста.
+    virtual void Serialize(std::string& out) const = 0;
 };
 
 // Парсит переданное выражение и возвращает объект формулы.
 // Бросает FormulaException в случае, если формула синтаксически некорректна.
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression);
+
+// Восстанавливает формулу, записанную FormulaInterface::Serialize.
+// Бросает SnapshotException, если данные повреждены.
+std::unique_ptr<FormulaInterface> DeserializeFormula(std::string_view data);
+
+// Общие разобранные формулы листа. Формулы ячеек, которые отличаются только
+// сдвигом ссылок вместе с ячейкой (=A1*B1 в C1, =A2*B2 в C2), хранят одно
+// неизменяемое дерево со ссылками относительно своей ячейки, а сами помнят
+// лишь её позицию. Текст и список ссылок строятся по запросу.
+class FormulaPool {
+public:
+    // Как ParseFormula, для формулы ячейки pos
+    std::unique_ptr<FormulaInterface> Parse(std::string_view expression, Position pos);
+    // Как DeserializeFormula, для формулы ячейки pos
+    std::unique_ptr<FormulaInterface> Deserialize(std::string_view data, Position pos);
+
+    // Число различных деревьев, на которые ещё ссылаются формулы
+    size_t GetSharedCount() const;
+
+private:
+    // Ключ - дерево, записанное со смещениями ссылок
+    std::unordered_map<std::string, std::weak_ptr<const FormulaAST>> formulas_;
+    // Размер, после которого из таблицы удаляются деревья без формул
+    size_t sweep_size_ = 1024;
+
+    std::unique_ptr<FormulaInterface> Share(FormulaAST ast, Position pos);
+};
+
+// Формулы FormulaPool с общим деревом в идущих подряд сверху вниз ячейках
+// одного столбца можно вычислять вместе, см. EvaluateColumn
+struct ColumnKey {
+    // Общее дерево формулы или nullptr, если формула разобрана не FormulaPool
+    const FormulaAST* tree = nullptr;
+    // Позиция ячейки формулы
+    Position origin;
+};
+ColumnKey GetColumnKey(const FormulaInterface& formula);
+
+// Вычисляет count формул с общим деревом: first и тех, что стоят на 1, 2, ...
+// строк ниже неё. Каждая операция выполняется сразу для всех строк над
+// непрерывными массивами, циклы по которым компилятор векторизует. В
+// values[i] записывается то же, что вернул бы Evaluate i-й формулы, в том
+// числе первая по порядку вычисления ошибка.
+void EvaluateColumn(const FormulaInterface& first, size_t count, const SheetInterface& sheet,
+                    FormulaInterface::Value* values);
+
+// Разбирает значение текстовой ячейки как число по тем же правилам, что и
+// operator>> потока с проверкой конца ввода: ведущие пробельные символы
+// пропускаются, допускается один знак, inf, nan и шестнадцатеричная запись не
+// допускаются, переполнение - ошибка. Возвращает nullopt, если текст не число.
+std::optional<double> ParseNumber(std::string_view text);
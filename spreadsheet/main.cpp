@@ -1,9 +1,31 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <limits>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <optional>
+#include <random>
+#include <string_view>
+#include <unordered_map>
 
+#include "FormulaAST.h"
+#include "buffered_writer.h"
 #include "common.h"
+#include "flat_hash_map.h"
 #include "formula.h"
+#include "log_duration.h"
+#include "range_index.h"
+#include "sheet.h"
+#include "snapshot_format.h"
 #include "test_runner_p.h"
 
+using namespace std::literals;
+
 inline std::ostream& operator<<(std::ostream& output, Position pos) {
     return output << "(" << pos.row << ", " << pos.col << ")";
 }
@@ -16,6 +38,10 @@ inline std::ostream& operator<<(std::ostream& output, Size size) {
     return output << "(" << size.rows << ", " << size.cols << ")";
 }
 
+inline std::ostream& operator<<(std::ostream& output, Range range) {
+    return output << range.first << ":" << range.last;
+}
+
 inline std::ostream& operator<<(std::ostream& output, const CellInterface::Value& value) {
     std::visit(
         [&](const auto& x) {
@@ -246,6 +272,32 @@ void TestErrorArithmetic() {
     }
 }
 
+void TestErrorPropagationOrder() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "text");
+    sheet->SetCell("A2"_pos, "=1/0");
+
+    // Побеждает первая ошибка в порядке вычисления слева направо
+    sheet->SetCell("B1"_pos, "=A1+1/0");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+    sheet->SetCell("B1"_pos, "=1/0+A1");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Arithmetic));
+    sheet->SetCell("B1"_pos, "=A2+A1");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Arithmetic));
+    sheet->SetCell("B1"_pos, "=-(A1)*A2");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+
+    // Ошибка ячейки проходит через цепочку формул без изменений
+    sheet->SetCell("C1"_pos, "=B1*2");
+    sheet->SetCell("C2"_pos, "=C1/0");
+    ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+
+    sheet->SetCell("A1"_pos, "1");
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Arithmetic));
+    sheet->SetCell("A2"_pos, "2");
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(-4.0));
+}
+
 void TestEmptyCellTreatedAsZero() {
     auto sheet = CreateSheet();
     sheet->SetCell("A1"_pos, "=B2");
@@ -361,9 +413,1673 @@ void TestClearPrint() {
     }
     std::cerr << std::endl;
 }
+
+void TestCellStorageTiles() {
+    auto sheet = CreateSheet();
+    const int size = 100;
+
+    for (int row = 0; row < size; ++row) {
+        for (int col = 0; col < size; ++col) {
+            sheet->SetCell(Position{row, col}, std::to_string(row * size + col));
+        }
+    }
+    sheet->SetCell(Position{Position::MAX_ROWS - 1, Position::MAX_COLS - 1}, "=A1+CV100");
+
+    ASSERT_EQUAL(sheet->GetCell("CV100"_pos)->GetText(), "9999");
+    ASSERT_EQUAL(sheet->GetCell("XFD16384"_pos)->GetValue(), CellInterface::Value(9999.0));
+
+    for (int row = 0; row < size; ++row) {
+        for (int col = 0; col < size; ++col) {
+            if (row != col) {
+                sheet->ClearCell(Position{row, col});
+            }
+        }
+    }
+    sheet->ClearCell("XFD16384"_pos);
+
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{size, size}));
+    ASSERT(sheet->GetCell("B1"_pos) == nullptr);
+    ASSERT_EQUAL(sheet->GetCell("CV100"_pos)->GetText(), "9999");
+
+    std::ostringstream texts;
+    sheet->PrintTexts(texts);
+
+    std::ostringstream expected;
+    for (int row = 0; row < size; ++row) {
+        for (int col = 0; col < size; ++col) {
+            if (col > 0) {
+                expected << '\t';
+            }
+            if (row == col) {
+                expected << row * size + col;
+            }
+        }
+        expected << '\n';
+    }
+    ASSERT_EQUAL(texts.str(), expected.str());
+}
+
+void TestSharedFormulas() {
+    Sheet sheet;
+    std::vector<std::pair<Position, std::string>> batch;
+    for (int row = 0; row < 100; ++row) {
+        const std::string r = std::to_string(row + 1);
+        batch.push_back({Position{row, 0}, r});
+        batch.push_back({Position{row, 1}, "2"});
+        batch.push_back({Position{row, 2}, "=A" + r + "*B" + r});
+    }
+    sheet.ApplyBatch(std::move(batch));
+
+    // Весь столбец C хранит одно дерево
+    ASSERT_EQUAL(sheet.GetFormulaPool().GetSharedCount(), 1u);
+    ASSERT_EQUAL(sheet.GetCell("C50"_pos)->GetText(), "=A50*B50");
+    ASSERT_EQUAL(sheet.GetCell("C50"_pos)->GetReferencedCells(), (std::vector{"A50"_pos, "B50"_pos}));
+    ASSERT_EQUAL(sheet.GetCell("C50"_pos)->GetValue(), CellInterface::Value(100.0));
+    ASSERT_EQUAL(sheet.GetConcreteCell("C7"_pos)->GetFormula()->GetExpression(), "A7*B7");
+
+    // Та же формула в другом столбце или с другой структурой - другое дерево
+    sheet.SetCell("D1"_pos, "=A1*B1");
+    sheet.SetCell("C5"_pos, "=A5+B5");
+    sheet.SetCell("C6"_pos, "=A6*B6");
+    ASSERT_EQUAL(sheet.GetFormulaPool().GetSharedCount(), 3u);
+    ASSERT_EQUAL(sheet.GetCell("C5"_pos)->GetValue(), CellInterface::Value(7.0));
+    ASSERT_EQUAL(sheet.GetCell("D1"_pos)->GetValue(), CellInterface::Value(2.0));
+
+    // Абсолютные ссылки строятся по позиции ячейки и в снимке
+    std::ostringstream snapshot;
+    sheet.SaveSnapshot(snapshot);
+    Sheet loaded;
+    std::istringstream input(snapshot.str());
+    loaded.LoadSnapshot(input);
+    ASSERT_EQUAL(loaded.GetFormulaPool().GetSharedCount(), 3u);
+    ASSERT_EQUAL(loaded.GetCell("C100"_pos)->GetText(), "=A100*B100");
+    loaded.SetCell("A100"_pos, "3");
+    ASSERT_EQUAL(loaded.GetCell("C100"_pos)->GetValue(), CellInterface::Value(6.0));
+
+    // Дерево живёт, пока на него ссылается хотя бы одна формула
+    sheet.ClearCell("D1"_pos);
+    sheet.SetCell("C5"_pos, "5");
+    ASSERT_EQUAL(sheet.GetFormulaPool().GetSharedCount(), 1u);
+    for (int row = 0; row < 100; ++row) {
+        sheet.ClearCell(Position{row, 2});
+    }
+    ASSERT_EQUAL(sheet.GetFormulaPool().GetSharedCount(), 0u);
+}
+
+void TestPrintSparse() {
+    std::mt19937 generator(13);
+    std::uniform_int_distribution<int> row_dist(0, 300);
+    std::uniform_int_distribution<int> col_dist(0, 200);
+
+    Sheet sheet;
+    for (int i = 0; i < 500; ++i) {
+        const Position pos{row_dist(generator), col_dist(generator)};
+        sheet.SetCell(pos, i % 3 == 0 ? "=" + Position{row_dist(generator), col_dist(generator)}.ToString() + "+1"
+                                      : std::to_string(i));
+    }
+    // Пустые ячейки, на которые ссылаются формулы, могут лежать за печатной областью
+    sheet.SetCell("A1"_pos, "=ZZ900");
+
+    const Size size = sheet.GetPrintableSize();
+    std::string expected;
+    for (int row = 0; row < size.rows; ++row) {
+        for (int col = 0; col < size.cols; ++col) {
+            if (col > 0) {
+                expected += '\t';
+            }
+            if (const auto* cell = sheet.GetCell(Position{row, col})) {
+                expected += cell->GetText();
+            }
+        }
+        expected += '\n';
+    }
+
+    std::ostringstream texts;
+    sheet.PrintTexts(texts);
+    ASSERT(texts.str() == expected);
+}
+
+void TestBufferedWriterNumbers() {
+    std::vector<double> numbers = {0.0, -0.0, 1.0, -2.5, 0.1, 1e-5, 0.0001, 123456.0, 1234567.0, 999999.5,
+                                   1e16, 1.0 / 3.0, 5e-324, std::numeric_limits<double>::max(),
+                                   std::numeric_limits<double>::infinity(),
+                                   -std::numeric_limits<double>::infinity(),
+                                   std::numeric_limits<double>::quiet_NaN()};
+    std::mt19937_64 generator(14);
+    for (int i = 0; i < 10000; ++i) {
+        const std::uint64_t bits = generator();
+        double number;
+        std::memcpy(&number, &bits, sizeof(number));
+        numbers.push_back(number);
+        numbers.push_back(static_cast<double>(bits % 100000000) / 1000.0);
+    }
+
+    std::ostringstream expected;
+    std::ostringstream actual;
+    BufferedWriter writer(actual);
+    for (double number : numbers) {
+        expected << number << '\t';
+        writer.WriteNumber(number);
+        writer.Write('\t');
+    }
+    writer.Flush();
+    ASSERT(actual.str() == expected.str());
+
+    // Несброшенные данные записываются при уничтожении
+    std::string output;
+    {
+        BufferedWriter string_writer(output);
+        string_writer.Write("tail");
+        string_writer.WriteNumber(1.5);
+    }
+    ASSERT_EQUAL(output, "tail1.5"s);
+}
+
+void TestParseNumberMatchesStream() {
+    const auto parse_with_stream = [](const std::string& text) -> std::optional<double> {
+        double result = 0;
+        std::istringstream in(text);
+        if (!(in >> result) || !in.eof()) {
+            return std::nullopt;
+        }
+        return result;
+    };
+
+    std::vector<std::string> texts = {"0", "-0", "+1", "+-1", "-+1", " 1", "1 ", "\t\n1", ".5", "5.", ".", "-.",
+                                      "1e5", "1E-5", "1e", "1e+", "1e400", "-1e400", "1e-400", "inf", "-nan",
+                                      "infinity", "0x10", "1,5", "--1", "00012", "3.14abc", "+", "-"};
+    std::mt19937 generator(17);
+    const std::string alphabet = " +-.eE0123456789xin";
+    std::uniform_int_distribution<size_t> letter(0, alphabet.size() - 1);
+    std::uniform_int_distribution<int> length(1, 8);
+    for (int i = 0; i < 20000; ++i) {
+        std::string text;
+        for (int j = length(generator); j > 0; --j) {
+            text += alphabet[letter(generator)];
+        }
+        texts.push_back(text);
+    }
+
+    for (const auto& text : texts) {
+        const auto expected = parse_with_stream(text);
+        const auto actual = ParseNumber(text);
+        ASSERT_EQUAL(actual.has_value(), expected.has_value());
+        if (expected) {
+            ASSERT_EQUAL(std::memcmp(&*actual, &*expected, sizeof(double)), 0);
+        }
+    }
+}
+
+// Формула из count слагаемых A1+A2+...
+std::string MakeSumOfColumn(int count) {
+    std::string expression;
+    for (int row = 0; row < count; ++row) {
+        expression += (row > 0 ? "+" : "") + Position{row, 0}.ToString();
+    }
+    return expression;
+}
+
+// Лист, доступный вычислителю только через SheetInterface: ячейки читаются
+// через GetValue с копированием значения
+class ForwardingSheet : public SheetInterface {
+public:
+    explicit ForwardingSheet(Sheet& sheet)
+        : sheet_(sheet) {
+    }
+
+    void SetCell(Position pos, std::string text) override {
+        sheet_.SetCell(pos, std::move(text));
+    }
+    const CellInterface* GetCell(Position pos) const override {
+        return sheet_.GetCell(pos);
+    }
+    CellInterface* GetCell(Position pos) override {
+        return sheet_.GetCell(pos);
+    }
+    void ClearCell(Position pos) override {
+        sheet_.ClearCell(pos);
+    }
+    Size GetPrintableSize() const override {
+        return sheet_.GetPrintableSize();
+    }
+    void PrintValues(std::ostream& output) const override {
+        sheet_.PrintValues(output);
+    }
+    void PrintTexts(std::ostream& output) const override {
+        sheet_.PrintTexts(output);
+    }
+
+private:
+    Sheet& sheet_;
+};
+
+void TestTypedReadsMatchGetValue() {
+    Sheet sheet;
+    for (int row = 0; row < 20; ++row) {
+        // Длинный текст не помещается в буфер малой строки
+        sheet.SetCell(Position{row, 0}, "  " + std::to_string(1e15 + row));
+    }
+    sheet.SetCell("B1"_pos, "=A1*2");
+    sheet.SetCell("B2"_pos, "text");
+    ForwardingSheet generic(sheet);
+
+    // Числа и ошибки, прочитанные без копирования значения, совпадают с
+    // прочитанными через GetValue
+    const auto formula = ParseFormula(MakeSumOfColumn(20) + "+B1");
+    const auto typed = formula->Evaluate(sheet);
+    ASSERT(std::holds_alternative<double>(typed));
+    ASSERT_EQUAL(std::get<double>(typed), std::get<double>(formula->Evaluate(generic)));
+
+    const auto error_formula = ParseFormula("A1+B2");
+    ASSERT(std::get<FormulaError>(error_formula->Evaluate(sheet)) == FormulaError(FormulaError::Category::Value));
+    ASSERT(std::get<FormulaError>(error_formula->Evaluate(generic)) == FormulaError(FormulaError::Category::Value));
+}
+
+void TestFlatHashMap() {
+    FlatHashMap<int> map;
+    std::map<PositionKey, int> reference;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> coord(0, 99);
+
+    for (int i = 0; i < 20000; ++i) {
+        const Position pos{coord(generator), coord(generator)};
+        ASSERT_EQUAL(UnpackPosition(PackPosition(pos)), pos);
+
+        const PositionKey key = PackPosition(pos);
+        if (i % 3 == 0) {
+            ASSERT_EQUAL(map.Erase(key), reference.erase(key) > 0);
+        } else {
+            map[key] = i;
+            reference[key] = i;
+        }
+    }
+
+    ASSERT_EQUAL(map.Size(), reference.size());
+    for (const auto& [key, value] : reference) {
+        ASSERT(map.Find(key) != nullptr);
+        ASSERT_EQUAL(*map.Find(key), value);
+    }
+
+    size_t visited = 0;
+    map.ForEach([&](PositionKey key, int value) {
+        ASSERT_EQUAL(reference.at(key), value);
+        ++visited;
+    });
+    ASSERT_EQUAL(visited, reference.size());
+
+    const Position last{Position::MAX_ROWS - 1, Position::MAX_COLS - 1};
+    ASSERT_EQUAL(UnpackPosition(PackPosition(last)), last);
+    ASSERT(map.Find(PackPosition(last)) == nullptr);
+}
+
+void TestRangeIndex() {
+    Sheet sheet;
+    std::vector<std::unique_ptr<Cell>> cells;
+    for (int i = 0; i < 8; ++i) {
+        cells.push_back(std::make_unique<Cell>(sheet));
+    }
+
+    RangeIndex index;
+    std::vector<std::pair<Range, Cell*>> reference;
+    std::mt19937 generator(42);
+    // Границы областей чаще попадают на края тайлов и полос
+    const auto coord = [&generator](int limit) {
+        const int value = std::uniform_int_distribution<int>(0, limit - 1)(generator);
+        return value % 3 == 0 ? (value & ~63) : value;
+    };
+    const auto random_range = [&]() {
+        Position first{coord(Position::MAX_ROWS), coord(300)};
+        Position last{coord(Position::MAX_ROWS), coord(300)};
+        return Range{{std::min(first.row, last.row), std::min(first.col, last.col)},
+                     {std::max(first.row, last.row), std::max(first.col, last.col)}};
+    };
+
+    const Range column{{0, 5}, {Position::MAX_ROWS - 1, 5}};
+    index.Add(column, cells[0].get());
+    reference.emplace_back(column, cells[0].get());
+    for (int i = 0; i < 3000; ++i) {
+        if (i % 4 == 3 && !reference.empty()) {
+            const size_t victim = std::uniform_int_distribution<size_t>(0, reference.size() - 1)(generator);
+            index.Remove(reference[victim].first, reference[victim].second);
+            reference.erase(reference.begin() + victim);
+        } else {
+            const Range range = random_range();
+            Cell* cell = cells[i % cells.size()].get();
+            index.Add(range, cell);
+            reference.emplace_back(range, cell);
+        }
+    }
+    ASSERT_EQUAL(index.Size(), reference.size());
+
+    for (int i = 0; i < 2000; ++i) {
+        const Position pos{coord(Position::MAX_ROWS), coord(320)};
+        std::map<Cell*, int> expected, found;
+        for (const auto& [range, cell] : reference) {
+            if (range.Contains(pos)) {
+                ++expected[cell];
+            }
+        }
+        index.ForEachContaining(pos, [&found](Cell* cell) {
+            ++found[cell];
+        });
+        ASSERT_EQUAL(found, expected);
+    }
+
+    for (const auto& [range, cell] : reference) {
+        index.Remove(range, cell);
+    }
+    ASSERT(index.IsEmpty());
+    index.ForEachContaining(Position{100, 5}, [](Cell*) {
+        ASSERT(false);
+    });
+}
+
+void TestFormulaProgramDeepNesting() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "1");
+
+    // Правоассоциативная запись требует стека глубже встроенного буфера
+    std::string expression;
+    const int depth = 100;
+    for (int i = 0; i < depth; ++i) {
+        expression += "A1-(";
+    }
+    expression += "A1";
+    expression += std::string(depth, ')');
+
+    auto formula = ParseFormula(expression);
+    ASSERT_EQUAL(std::get<double>(formula->Evaluate(*sheet)), 1.0);
+
+    sheet->SetCell("A1"_pos, "=1/0");
+    ASSERT_EQUAL(std::get<FormulaError>(formula->Evaluate(*sheet)), FormulaError(FormulaError::Category::Arithmetic));
+
+    sheet->SetCell("B1"_pos, "=-(A2*-3)/+4");
+    sheet->SetCell("A2"_pos, "2");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(1.5));
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "=-A2*-3/+4");
+}
+
+void TestFormulaSimplification() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "5");
+    sheet->SetCell("A2"_pos, "=-0");
+
+    // Упрощения не меняют ни текст формулы, ни её значение
+    const std::vector<std::pair<std::string, double>> cases = {
+        {"=2*3*A1+0", 30},    {"=-(-A1)", 5},       {"=--A1*1", 5},
+        {"=1*A1/1-0", 5},     {"=-1*A1", -5},       {"=A1/-1", -5},
+        {"=(1+2)*(A1-0)", 15}, {"=+A1*+1", 5},      {"=-(2-3)*A1", 5},
+        {"=A1*-1*-1", 5},     {"=-(-(1/4))", 0.25},
+    };
+    for (const auto& [text, value] : cases) {
+        sheet->SetCell("B1"_pos, text);
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(value));
+    }
+    sheet->SetCell("B1"_pos, "=2*3*A1+0");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "=2*3*A1+0");
+    sheet->SetCell("B1"_pos, "=-(-A1)");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "=--A1");
+
+    // Знак нуля сохраняется: x*1 и x-0 дают x, а x+0 превращает -0 в +0
+    sheet->SetCell("B1"_pos, "=A2*1-0");
+    ASSERT(std::signbit(std::get<double>(sheet->GetCell("B1"_pos)->GetValue())));
+    sheet->SetCell("B1"_pos, "=A2+0");
+    ASSERT(!std::signbit(std::get<double>(sheet->GetCell("B1"_pos)->GetValue())));
+    sheet->SetCell("B1"_pos, "=-0+0");
+    ASSERT(!std::signbit(std::get<double>(sheet->GetCell("B1"_pos)->GetValue())));
+
+    // Константы с бесконечным результатом не сворачиваются, и первой
+    // по-прежнему оказывается ошибка ячейки слева
+    sheet->SetCell("A3"_pos, "text");
+    sheet->SetCell("B1"_pos, "=A3+1/0*1");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+    sheet->SetCell("B1"_pos, "=1e200*1e200-A3");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Arithmetic));
+}
+
+void TestInvalidateDiamondLayers() {
+    auto sheet = CreateSheet();
+    const int layers = 64;
+
+    // В каждом слое две ячейки, обе ссылаются на обе ячейки предыдущего:
+    // до последнего слоя ведёт 2^63 путей
+    sheet->SetCell(Position{0, 0}, "1");
+    sheet->SetCell(Position{0, 1}, "1");
+    for (int row = 1; row < layers; ++row) {
+        const auto prev = std::to_string(row);
+        sheet->SetCell(Position{row, 0}, "=(A" + prev + "+B" + prev + ")/2");
+        sheet->SetCell(Position{row, 1}, "=A" + prev + "-B" + prev + "+B" + prev);
+    }
+
+    const Position last{layers - 1, 0};
+    ASSERT_EQUAL(sheet->GetCell(last)->GetValue(), CellInterface::Value(1.0));
+
+    sheet->SetCell(Position{0, 0}, "3");
+    sheet->SetCell(Position{0, 1}, "3");
+    ASSERT_EQUAL(sheet->GetCell(last)->GetValue(), CellInterface::Value(3.0));
+}
+
+void TestCircularReferencesAfterReordering() {
+    auto sheet = CreateSheet();
+
+    // Цепочка строится от конца к началу, поэтому каждая новая ссылка
+    // нарушает порядок создания ячеек
+    sheet->SetCell("A1"_pos, "=B1");
+    sheet->SetCell("B1"_pos, "=C1");
+    sheet->SetCell("D1"_pos, "=A1");
+    sheet->SetCell("C1"_pos, "=E1+F1");
+
+    auto is_circular = [&](Position pos, const std::string& text) {
+        try {
+            sheet->SetCell(pos, text);
+        } catch (const CircularDependencyException&) {
+            return true;
+        }
+        return false;
+    };
+
+    ASSERT(is_circular("E1"_pos, "=D1"));
+    ASSERT(is_circular("F1"_pos, "=A1*2"));
+    ASSERT(!is_circular("E1"_pos, "=G1"));
+    ASSERT(is_circular("G1"_pos, "=D1"));
+    ASSERT_EQUAL(sheet->GetCell("G1"_pos)->GetText(), "");
+
+    // Случайные правки сверяются с поиском цикла полным обходом
+    std::mt19937 generator(5);
+    std::uniform_int_distribution<int> coord(0, 5);
+    std::uniform_int_distribution<int> refs_count(0, 3);
+
+    auto reaches = [&](Position from, Position target) {
+        std::vector<Position> to_visit{from};
+        std::set<Position> visited;
+        while (!to_visit.empty()) {
+            const Position current = to_visit.back();
+            to_visit.pop_back();
+            if (current == target) {
+                return true;
+            }
+            const CellInterface* cell = sheet->GetCell(current);
+            if (!cell || !visited.insert(current).second) {
+                continue;
+            }
+            for (Position next : cell->GetReferencedCells()) {
+                to_visit.push_back(next);
+            }
+        }
+        return false;
+    };
+
+    for (int i = 0; i < 2000; ++i) {
+        const Position pos{coord(generator), coord(generator)};
+        std::string text = "=0";
+        bool expected = false;
+        for (int j = refs_count(generator); j > 0; --j) {
+            const Position ref{coord(generator), coord(generator)};
+            text += "+" + ref.ToString();
+            expected = expected || reaches(ref, pos);
+        }
+
+        const std::string old_text = sheet->GetCell(pos) ? sheet->GetCell(pos)->GetText() : "";
+        ASSERT_EQUAL(is_circular(pos, text), expected);
+        if (expected) {
+            ASSERT_EQUAL(sheet->GetCell(pos)->GetText(), old_text);
+        }
+    }
+}
+
+// Заполняет лист сеткой формул: каждая ячейка ссылается на две ячейки
+// предыдущей строки, среди входных данных есть текст и деление на ноль
+void FillFormulaGrid(SheetInterface& sheet, int rows, int cols) {
+    for (int col = 0; col < cols; ++col) {
+        sheet.SetCell(Position{0, col}, col % 7 == 3 ? "text" : std::to_string(col % 5));
+    }
+    for (int row = 1; row < rows; ++row) {
+        const auto prev = std::to_string(row);
+        for (int col = 0; col < cols; ++col) {
+            const auto left = Position{row - 1, col}.ToString();
+            const auto right = Position{row - 1, (col + 1) % cols}.ToString();
+            sheet.SetCell(Position{row, col}, "=" + left + "*0.5+" + right + "/(" + prev + "-" + std::to_string(col % 9) + ")");
+        }
+    }
+}
+
+void TestPrintValuesToFd() {
+    Sheet sheet;
+    FillFormulaGrid(sheet, 40, 300);
+    sheet.SetCell("B2"_pos, "=1/0");
+    sheet.SetCell("C2"_pos, "'text");
+
+    std::ostringstream expected;
+    sheet.PrintValues(expected);
+
+    std::FILE* file = std::tmpfile();
+    sheet.PrintValues(fileno(file));
+    std::string actual(expected.str().size() + 1, '\0');
+    std::rewind(file);
+    actual.resize(std::fread(actual.data(), 1, actual.size(), file));
+    std::fclose(file);
+
+    ASSERT(actual == expected.str());
+}
+
+void TestExportValues() {
+    Sheet sheet;
+    FillFormulaGrid(sheet, 700, 90);
+    sheet.SetCell("C1000"_pos, "=1/0");
+    sheet.SetCell("CZ1500"_pos, "'far");
+    sheet.ClearCell("B300"_pos);
+
+    std::ostringstream serial;
+    sheet.PrintValues(serial);
+
+    for (size_t threads : {1, 3, 8}) {
+        std::ostringstream parallel;
+        sheet.ExportValues(parallel, threads);
+        ASSERT(parallel.str() == serial.str());
+    }
+
+    Sheet empty;
+    std::ostringstream empty_output;
+    empty.ExportValues(empty_output, 4);
+    ASSERT(empty_output.str().empty());
+}
+
+void TestRangeConversion() {
+    ASSERT_EQUAL(Range::FromString("A1:C10"), (Range{"A1"_pos, "C10"_pos}));
+    ASSERT_EQUAL((Range{"B2"_pos, "ZZ40"_pos}).ToString(), "B2:ZZ40");
+    ASSERT_EQUAL((Range{"B2"_pos, "D5"_pos}).GetSize(), (Size{4, 3}));
+    ASSERT((Range{"B2"_pos, "D5"_pos}).Contains("C5"_pos));
+    ASSERT(!(Range{"B2"_pos, "D5"_pos}).Contains("E5"_pos));
+
+    for (const auto* text : {"", "A1", "A1:", ":B2", "B2:A1", "A2:B1", "A1:B2:C3", "A0:B2", "A1-B2"}) {
+        ASSERT(!Range::FromString(text).IsValid());
+    }
+}
+
+void TestRangeValues() {
+    Sheet sheet;
+    FillFormulaGrid(sheet, 200, 150);
+    sheet.SetCell("ZZ1"_pos, "=1/0");
+
+    std::ostringstream full;
+    sheet.PrintValues(full);
+    std::vector<std::vector<std::string>> grid;
+    std::istringstream lines(full.str());
+    for (std::string line; std::getline(lines, line);) {
+        auto& row = grid.emplace_back();
+        std::istringstream fields(line);
+        for (std::string field; std::getline(fields, field, '\t');) {
+            row.push_back(field);
+        }
+    }
+
+    // Окно частично выходит за печатную область
+    const Range range{"EN190"_pos, "FA220"_pos};
+    std::string expected;
+    for (int row = range.first.row; row <= range.last.row; ++row) {
+        for (int col = range.first.col; col <= range.last.col; ++col) {
+            if (col > range.first.col) {
+                expected += '\t';
+            }
+            if (row < static_cast<int>(grid.size()) && col < static_cast<int>(grid[row].size())) {
+                expected += grid[row][col];
+            }
+        }
+        expected += '\n';
+    }
+    std::ostringstream window;
+    sheet.PrintValues(window, range);
+    ASSERT(window.str() == expected);
+
+    std::vector<CellInterface::Value> values;
+    sheet.GetValues(range, values);
+    ASSERT_EQUAL(values.size(), 31u * 14u);
+    ASSERT_EQUAL(values[0], sheet.GetCell("EN190"_pos)->GetValue());
+    ASSERT_EQUAL(values.back(), CellInterface::Value(""s));
+
+    // Вычисляются только формулы окна и то, от чего они зависят
+    sheet.SetCell("A1"_pos, "1");
+    sheet.GetValues({"B2"_pos, "C3"_pos}, values);
+    ASSERT_EQUAL(values.size(), 4u);
+    ASSERT(!sheet.GetConcreteCell("B3"_pos)->IsDirty());
+    ASSERT(!sheet.GetConcreteCell("C2"_pos)->IsDirty());
+    ASSERT(sheet.GetConcreteCell("A3"_pos)->IsDirty());
+    ASSERT(sheet.GetConcreteCell("EN190"_pos)->IsDirty());
+
+    try {
+        sheet.GetValues({"C3"_pos, "B2"_pos}, values);
+        ASSERT(false);
+    } catch (const InvalidPositionException&) {
+    }
+}
+
+void TestParallelRecalculate() {
+    const int rows = 40;
+    const int cols = 300;
+
+    Sheet serial;
+    Sheet parallel;
+    FillFormulaGrid(serial, rows, cols);
+    FillFormulaGrid(parallel, rows, cols);
+
+    parallel.Recalculate(4);
+    std::ostringstream serial_values;
+    std::ostringstream parallel_values;
+    serial.PrintValues(serial_values);
+    parallel.PrintValues(parallel_values);
+    ASSERT(serial_values.str() == parallel_values.str());
+
+    serial.SetCell("B1"_pos, "17");
+    parallel.SetCell("B1"_pos, "17");
+    parallel.Recalculate(3);
+    ASSERT_EQUAL(parallel.GetCell(Position{rows - 1, 0})->GetValue(),
+                 serial.GetCell(Position{rows - 1, 0})->GetValue());
+}
+
+void TestColumnEvaluation() {
+    const int rows = 300;
+    const auto fill = [](Sheet& sheet) {
+        std::vector<std::pair<Position, std::string>> batch;
+        for (int row = 0; row < rows; ++row) {
+            const std::string r = std::to_string(row + 1);
+            // Среди входов есть пустые ячейки, текст, ошибки и нули
+            if (row % 7 != 3) {
+                batch.push_back({Position{row, 0}, row % 11 == 5 ? "text" : std::to_string(row % 5)});
+            }
+            batch.push_back({Position{row, 1}, row % 13 == 6 ? "=1/0" : std::to_string(row % 3)});
+            batch.push_back({Position{row, 2}, row % 17 == 8 ? "'x" : "1.5"});
+            batch.push_back({Position{row, 3}, "=A" + r + "*B" + r + "+C" + r});
+            batch.push_back({Position{row, 4}, "=C" + r + "/(A" + r + "-B" + r + ")"});
+            batch.push_back({Position{row, 5}, "=-D" + r + "+1e308*E" + r});
+        }
+        sheet.ApplyBatch(std::move(batch));
+    };
+
+    Sheet serial, parallel;
+    fill(serial);
+    fill(parallel);
+    serial.Recalculate(1);
+    parallel.Recalculate(4);
+
+    // Значения столбцов совпадают с вычислением каждой формулы отдельно
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 3; col < 6; ++col) {
+            const Position pos{row, col};
+            const CellInterface::Value expected = std::visit([](auto value) {
+                return CellInterface::Value(value);
+            }, serial.GetConcreteCell(pos)->GetFormula()->Evaluate(serial));
+            ASSERT_EQUAL(serial.GetCell(pos)->GetValue(), expected);
+            ASSERT_EQUAL(parallel.GetCell(pos)->GetValue(), expected);
+        }
+    }
+
+    serial.SetCell("A5"_pos, "10");
+    serial.Recalculate(1);
+    ASSERT_EQUAL(serial.GetCell("F5"_pos)->GetValue(), CellInterface::Value(-(10.0 * 1 + 1.5) + 1e308 * (1.5 / (10.0 - 1))));
+}
+
+void TestRangeFunctions() {
+    // Любые два противоположных угла задают одну область
+    ASSERT_EQUAL(ParseFormula("SUM( B2 : A1 , 2*C3 )")->GetExpression(), "SUM(A1:B2,2*C3)");
+    ASSERT_EQUAL(ParseFormula("-MAX(A1:A3)*(COUNT(B1,1)+1)")->GetExpression(), "-MAX(A1:A3)*(COUNT(B1,1)+1)");
+    ASSERT_EQUAL(ParseFormula("AVERAGE(A1:B2,C1:C5,A1:B2)+D1")->GetReferencedRanges(),
+                 (std::vector{Range{"A1"_pos, "B2"_pos}, Range{"C1"_pos, "C5"_pos}}));
+    ASSERT_EQUAL(ParseFormula("SUM(A1:B2,C3)")->GetReferencedCells(), std::vector{"C3"_pos});
+
+    for (const char* incorrect : {"A1:A2", "SUM()", "SUM(A1:A2", "SUM(A1,)", "SUM(A1:)", "SUM(A1:2)",
+                                  "SUMMA(A1)", "SUM+(A1)", "SUM(A1:A2+1)", "sum(A1)", "SUM(A1:A2)+A3:A4"}) {
+        try {
+            ParseFormula(incorrect);
+            ASSERT(false);
+        } catch (const FormulaException&) {
+        }
+    }
+
+    Sheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("A2"_pos, "text");
+    sheet.SetCell("A3"_pos, "'");
+    sheet.SetCell("A4"_pos, "4");
+    sheet.SetCell("B1"_pos, "2.5");
+    sheet.SetCell("B2"_pos, "=A1*10");
+    sheet.SetCell("B4"_pos, "'-3");
+
+    const auto value = [&sheet](const std::string& formula) {
+        sheet.SetCell("D1"_pos, "=" + formula);
+        return sheet.GetCell("D1"_pos)->GetValue();
+    };
+
+    // Пустые ячейки и текст, который не является числом, пропускаются
+    ASSERT_EQUAL(value("SUM(A1:B5)"), CellInterface::Value(1 + 4 + 2.5 + 10 - 3.0));
+    ASSERT_EQUAL(value("COUNT(A1:B5)"), CellInterface::Value(5.0));
+    ASSERT_EQUAL(value("AVERAGE(A1:B5,C1,7)"), CellInterface::Value(21.5 / 7));
+    ASSERT_EQUAL(value("MIN(A1:B5)"), CellInterface::Value(-3.0));
+    ASSERT_EQUAL(value("MAX(A1:B5,-100)"), CellInterface::Value(10.0));
+    ASSERT_EQUAL(value("MIN(C1:C5)+MAX(C1:C5)+SUM(C1:C5)+COUNT(C1:C5)"), CellInterface::Value(0.0));
+    ASSERT_EQUAL(value("SUM(A1:A4)-A1-A4"), CellInterface::Value(0.0));
+
+    // Сумма копится по порядку и совпадает с записанной через сложения
+    sheet.SetCell("C1"_pos, "0.1");
+    sheet.SetCell("C2"_pos, "0.2");
+    sheet.SetCell("C3"_pos, "0.3");
+    ASSERT_EQUAL(value("SUM(C1:C3)"), value("C1+C2+C3"));
+
+    // Ошибки: первая по порядку вычисления, области обходятся по столбцам
+    ASSERT_EQUAL(value("AVERAGE(C4:C5)"), CellInterface::Value(FormulaError(FormulaError::Category::Arithmetic)));
+    ASSERT_EQUAL(value("SUM(A2)"), CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+    ASSERT_EQUAL(value("MAX(1e308,1e308)+0"), CellInterface::Value(1e308));
+    ASSERT_EQUAL(value("SUM(1e308,1e308)"), CellInterface::Value(FormulaError(FormulaError::Category::Arithmetic)));
+    sheet.SetCell("E1"_pos, "=1/0");
+    sheet.SetCell("F1"_pos, "=A2");
+    sheet.SetCell("E2"_pos, "=A2+1");
+    ASSERT_EQUAL(value("SUM(E1:F2)"), CellInterface::Value(FormulaError(FormulaError::Category::Arithmetic)));
+    ASSERT_EQUAL(value("SUM(E2:F2,E1)"), CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+    ASSERT_EQUAL(value("COUNT(F1:F2)"), CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+}
+
+void TestRangeDependencies() {
+    Sheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=SUM(A1:A100)");
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), CellInterface::Value(1.0));
+    ASSERT(sheet.GetCell("B1"_pos)->GetReferencedCells().empty());
+
+    // Изменение любой ячейки области сбрасывает кеш, пустые ячейки не создаются
+    sheet.SetCell("A50"_pos, "2");
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), CellInterface::Value(3.0));
+    ASSERT(sheet.GetCell("A2"_pos) == nullptr);
+    sheet.ApplyBatch({{"A3"_pos, "=A1*10"}, {"C1"_pos, "=B1+1"}});
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(14.0));
+    sheet.SetCell("A1"_pos, "2");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(25.0));
+    sheet.ClearCell("A50"_pos);
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(23.0));
+    sheet.SetCell("A3"_pos, "7");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(10.0));
+
+    // Циклы через области обнаруживаются, лист при этом не меняется
+    for (const auto& [pos, text] : {std::pair{"A7"_pos, "=C1"}, std::pair{"A8"_pos, "=SUM(A8:A9)"},
+                                    std::pair{"D1"_pos, "=SUM(A1:D1)"}}) {
+        try {
+            sheet.SetCell(pos, text);
+            ASSERT(false);
+        } catch (const CircularDependencyException&) {
+        }
+    }
+    try {
+        sheet.ApplyBatch({{"D5"_pos, "=SUM(A5:A6)"}, {"A6"_pos, "=D5"}});
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+    ASSERT(sheet.GetCell("A7"_pos) == nullptr);
+    ASSERT(sheet.GetCell("D5"_pos) == nullptr);
+
+    // Заменённая формула больше не зависит от своей области
+    sheet.SetCell("B1"_pos, "=MAX(A1:A2)");
+    sheet.SetCell("A7"_pos, "=C1");
+    ASSERT_EQUAL(sheet.GetCell("A7"_pos)->GetValue(), CellInterface::Value(3.0));
+    sheet.ClearCell("B1"_pos);
+    sheet.SetCell("A1"_pos, "=SUM(B1:B3)");
+    ASSERT_EQUAL(sheet.GetCell("A7"_pos)->GetValue(), CellInterface::Value(1.0));
+
+    // Формула, заполненная вниз, вычисляется столбцом и после снимка
+    // сохраняет зависимости
+    Sheet column;
+    std::vector<std::pair<Position, std::string>> batch;
+    for (int row = 0; row < 100; ++row) {
+        const std::string r = std::to_string(row + 1);
+        batch.push_back({Position{row, 0}, std::to_string(row)});
+        batch.push_back({Position{row, 1}, "=SUM(A" + r + ":A" + std::to_string(row + 3)
+                                            + ")-COUNT(A" + r + ":A" + std::to_string(row + 2) + ")"});
+    }
+    column.ApplyBatch(std::move(batch));
+    column.Recalculate(4);
+    for (int row = 0; row < 100; ++row) {
+        double sum = 0;
+        for (int i = row; i <= row + 2 && i < 100; ++i) {
+            sum += i;
+        }
+        const double count = row + 1 < 100 ? 2 : 1;
+        ASSERT_EQUAL(column.GetCell(Position{row, 1})->GetValue(), CellInterface::Value(sum - count));
+    }
+
+    std::ostringstream snapshot;
+    column.SaveSnapshot(snapshot);
+    Sheet loaded;
+    std::istringstream input(snapshot.str());
+    loaded.LoadSnapshot(input);
+    ASSERT_EQUAL(loaded.GetCell("B1"_pos)->GetText(), "=SUM(A1:A3)-COUNT(A1:A2)");
+    loaded.SetCell("A2"_pos, "100");
+    ASSERT_EQUAL(loaded.GetCell("B1"_pos)->GetValue(), CellInterface::Value(100.0));
+    try {
+        loaded.SetCell("A3"_pos, "=B1");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+
+    // Ссылка на весь столбец в заполненном тайле видит только свой столбец
+    Sheet dense;
+    batch.clear();
+    for (int row = 0; row < 64; ++row) {
+        for (int col = 0; col < 64; ++col) {
+            batch.push_back({Position{row, col}, col == 2 ? "1" : "=1"});
+        }
+    }
+    dense.ApplyBatch(std::move(batch));
+    dense.SetCell("CA1"_pos, "=SUM(C1:C16384)");
+    ASSERT(dense.GetCell("CA1"_pos)->GetReferencedCells().empty());
+    dense.SetCell("C16384"_pos, "=C1+1");
+    ASSERT_EQUAL(dense.GetCell("CA1"_pos)->GetValue(), CellInterface::Value(66.0));
+    try {
+        dense.SetCell("C1"_pos, "=CA1");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+    dense.ClearCell("C16384"_pos);
+    dense.SetCell("C1"_pos, "5");
+    ASSERT_EQUAL(dense.GetCell("CA1"_pos)->GetValue(), CellInterface::Value(68.0));
+}
+
+void TestSumIndex() {
+    // Лист с индексом сумм и без него дают одинаковые значения: числа
+    // целые, поэтому порядок сложения не влияет на результат
+    Sheet indexed, plain;
+    indexed.SetCell("B2"_pos, "5");
+    indexed.SetSumIndexRegion(Range{"A1"_pos, "J200"_pos});
+    plain.SetCell("B2"_pos, "5");
+
+    std::vector<std::pair<Position, std::string>> totals;
+    for (int i = 0; i < 40; ++i) {
+        const std::string first = Position{i * 4, i % 5}.ToString();
+        const std::string last = Position{i * 4 + 30, i % 5 + 4}.ToString();
+        const std::string range = first + ":" + last;
+        totals.push_back({Position{i, 12}, "=SUM(" + range + ")+COUNT(" + range + ")/1000"});
+        totals.push_back({Position{i, 13}, "=AVERAGE(" + range + ")"});
+    }
+    // Область выходит за индекс и считается перебором
+    totals.push_back({"O1"_pos, "=SUM(A1:K300)"});
+    indexed.ApplyBatch(totals);
+    plain.ApplyBatch(totals);
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> row(0, 219), col(0, 10), kind(0, 9);
+    for (int i = 0; i < 2000; ++i) {
+        const int k = kind(generator);
+        // Формулы пишутся в столбец J: он в индексе, но вне окон итогов
+        const Position pos{row(generator), k == 2 ? 9 : col(generator)};
+        if (k == 0) {
+            indexed.ClearCell(pos);
+            plain.ClearCell(pos);
+            continue;
+        }
+        const std::string text = k == 1 ? "text" : k == 2 ? "=" + std::to_string(i) : std::to_string(i - 1000);
+        if (k == 3) {
+            indexed.ApplyBatch({{pos, text}, {Position{pos.row, pos.col + 1}, "'7"}});
+            plain.ApplyBatch({{pos, text}, {Position{pos.row, pos.col + 1}, "'7"}});
+        } else {
+            indexed.SetCell(pos, text);
+            plain.SetCell(pos, text);
+        }
+
+        if (i % 100 == 0) {
+            for (const auto& [total, formula] : totals) {
+                ASSERT_EQUAL(indexed.GetCell(total)->GetValue(), plain.GetCell(total)->GetValue());
+            }
+        }
+    }
+
+    // Без формул в области сумма берётся из индекса
+    Sheet numbers;
+    numbers.SetSumIndexRegion(Range{"A1"_pos, "B100"_pos});
+    for (int row = 0; row < 100; ++row) {
+        numbers.SetCell(Position{row, 0}, std::to_string(row));
+    }
+    double sum = 0, count = 0;
+    ASSERT(numbers.TrySumRange(Range{"A1"_pos, "B100"_pos}, sum, count));
+    ASSERT_EQUAL(sum, 4950.0);
+    ASSERT_EQUAL(count, 100.0);
+    numbers.SetCell("B50"_pos, "=A1");
+    ASSERT(!numbers.TrySumRange(Range{"A1"_pos, "B100"_pos}, sum, count));
+    ASSERT(numbers.TrySumRange(Range{"A1"_pos, "A100"_pos}, sum, count));
+    ASSERT(!numbers.TrySumRange(Range{"A1"_pos, "A101"_pos}, sum, count));
+
+    // Загруженный снимок попадает в индекс
+    std::ostringstream snapshot;
+    numbers.SaveSnapshot(snapshot);
+    numbers.SetCell("A1"_pos, "1000");
+    std::istringstream input(snapshot.str());
+    numbers.LoadSnapshot(input);
+    ASSERT(numbers.TrySumRange(Range{"A1"_pos, "A100"_pos}, sum, count));
+    ASSERT_EQUAL(sum, 4950.0);
+
+    numbers.SetSumIndexRegion(std::nullopt);
+    ASSERT(!numbers.TrySumRange(Range{"A1"_pos, "A100"_pos}, sum, count));
+
+    // Малые слагаемые рядом с большими, в том числе стёртыми, не теряются
+    // в суммах индекса
+    Sheet large;
+    large.SetSumIndexRegion(Range{"A1"_pos, "A100"_pos});
+    large.ApplyBatch({{"A1"_pos, "1e17"}, {"A5"_pos, "1"}, {"A6"_pos, "2"}, {"B1"_pos, "=SUM(A5:A6)"}});
+    ASSERT_EQUAL(large.GetCell("B1"_pos)->GetValue(), CellInterface::Value(3.0));
+    large.ApplyBatch({{"A1"_pos, "1e20"}, {"A2"_pos, "1"}, {"B2"_pos, "=SUM(A1:A2)"}});
+    large.SetCell("A1"_pos, "0");
+    ASSERT_EQUAL(large.GetCell("B2"_pos)->GetValue(), CellInterface::Value(1.0));
+    ASSERT_EQUAL(large.GetCell("B1"_pos)->GetValue(), CellInterface::Value(3.0));
+    large.SetCell("A7"_pos, "1e20");
+    large.SetCell("A7"_pos, "4");
+    large.SetCell("B3"_pos, "=SUM(A7:A7)+COUNT(A1:A100)");
+    ASSERT_EQUAL(large.GetCell("B3"_pos)->GetValue(), CellInterface::Value(9.0));
+    ASSERT(large.TrySumRange(Range{"A5"_pos, "A6"_pos}, sum, count));
+    ASSERT_EQUAL(sum, 3.0);
+    ASSERT(large.TrySumRange(Range{"A1"_pos, "A2"_pos}, sum, count));
+    ASSERT_EQUAL(sum, 1.0);
+
+    // Перестроенный индекс снова отвечает сам
+    large.SetSumIndexRegion(Range{"A1"_pos, "A100"_pos});
+    ASSERT(large.TrySumRange(Range{"A1"_pos, "A7"_pos}, sum, count));
+    ASSERT_EQUAL(sum, 8.0);
+
+    // Там, где от порядка сложения зависит округление, сумма считается
+    // перебором и совпадает с суммой ячеек по порядку бит в бит
+    Sheet rounding, rounding_plain;
+    rounding.SetSumIndexRegion(Range{"A1"_pos, "C10"_pos});
+    for (Sheet* sheet : {&rounding, &rounding_plain}) {
+        sheet->ApplyBatch({{"A1"_pos, "0.1"}, {"A2"_pos, "0.2"}, {"A3"_pos, "0.3"},
+                           {"B1"_pos, "1e16"}, {"B2"_pos, "1"}, {"B3"_pos, "-1e16"},
+                           {"C1"_pos, "4294967296"}, {"C2"_pos, "-4294967295"},
+                           {"E1"_pos, "=SUM(A1:A3)"}, {"E2"_pos, "=A1+A2+A3"},
+                           {"F1"_pos, "=SUM(B1:B3)"}, {"F2"_pos, "=B1+B2+B3"},
+                           {"G1"_pos, "=AVERAGE(A1:B3)"}, {"G2"_pos, "=(A1+A2+A3+B1+B2+B3)/6"},
+                           {"H1"_pos, "=SUM(C1:C2)"}});
+    }
+    ASSERT(!rounding.TrySumRange(Range{"A1"_pos, "A3"_pos}, sum, count));
+    ASSERT(!rounding.TrySumRange(Range{"B1"_pos, "B3"_pos}, sum, count));
+    ASSERT(rounding.TrySumRange(Range{"C1"_pos, "C2"_pos}, sum, count));
+    ASSERT(rounding.TrySumRange(Range{"B2"_pos, "B2"_pos}, sum, count));
+    for (const auto& [total, expected] : {std::pair("E1"_pos, "E2"_pos), std::pair("F1"_pos, "F2"_pos),
+                                          std::pair("G1"_pos, "G2"_pos)}) {
+        ASSERT_EQUAL(rounding.GetCell(total)->GetValue(), rounding.GetCell(expected)->GetValue());
+        ASSERT_EQUAL(rounding.GetCell(total)->GetValue(), rounding_plain.GetCell(total)->GetValue());
+    }
+    ASSERT_EQUAL(rounding.GetCell("F1"_pos)->GetValue(), CellInterface::Value(0.0));
+    ASSERT_EQUAL(rounding.GetCell("H1"_pos)->GetValue(), CellInterface::Value(1.0));
+}
+
+void TestLongDependencyChain() {
+    auto sheet = CreateSheet();
+    const int length = 200000;
+
+    // Цепочка идёт по столбцам сверху вниз: каждая ячейка ссылается на предыдущую
+    auto position = [](int index) {
+        return Position{index % Position::MAX_ROWS, index / Position::MAX_ROWS};
+    };
+
+    sheet->SetCell(position(0), "1");
+    for (int i = 1; i < length; ++i) {
+        sheet->SetCell(position(i), "=" + position(i - 1).ToString() + "+1");
+    }
+    ASSERT_EQUAL(sheet->GetCell(position(length - 1))->GetValue(), CellInterface::Value(double(length)));
+
+    sheet->SetCell(position(0), "=-1");
+    ASSERT_EQUAL(sheet->GetCell(position(length - 1))->GetValue(), CellInterface::Value(double(length - 2)));
+}
+
+void TestApplyBatch() {
+    Sheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1*10");
+
+    sheet.ApplyBatch({{"C1"_pos, "=B1+D1"}, {"D1"_pos, "=A2"}, {"A2"_pos, "5"}, {"A1"_pos, "2"}, {"A2"_pos, "3"}});
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(23.0));
+    ASSERT_EQUAL(sheet.GetPrintableSize(), (Size{2, 4}));
+
+    auto print_texts = [&sheet]() {
+        std::ostringstream out;
+        sheet.PrintTexts(out);
+        return out.str();
+    };
+    const std::string before = print_texts();
+
+    // Цикл замыкается только объединением нескольких ячеек пакета
+    try {
+        sheet.ApplyBatch({{"E5"_pos, "=F5"}, {"A2"_pos, "=E5"}, {"F5"_pos, "=C1"}});
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+    ASSERT_EQUAL(print_texts(), before);
+    ASSERT(sheet.GetCell("E5"_pos) == nullptr);
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(23.0));
+
+    try {
+        sheet.ApplyBatch({{"A1"_pos, "7"}, {"A3"_pos, "=1+"}});
+        ASSERT(false);
+    } catch (const FormulaException&) {
+    }
+    ASSERT_EQUAL(print_texts(), before);
+
+    sheet.ApplyBatch({{"A2"_pos, ""}, {"A1"_pos, "=A2+1"}});
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(10.0));
+    ASSERT_EQUAL(sheet.GetPrintableSize(), (Size{1, 4}));
+}
+
+void TestLoadTexts() {
+    Sheet original;
+    FillFormulaGrid(original, 30, 400);
+    original.SetCell("B2"_pos, "'=escaped");
+    original.SetCell("C3"_pos, "");
+    original.SetCell("ZZ40"_pos, "=A1+ZZ41");
+    original.SetCell("ZZ41"_pos, "tail");
+
+    std::ostringstream texts;
+    original.PrintTexts(texts);
+
+    Sheet loaded;
+    std::istringstream input(texts.str());
+    loaded.LoadTexts(input);
+
+    std::ostringstream loaded_texts;
+    loaded.PrintTexts(loaded_texts);
+    ASSERT(loaded_texts.str() == texts.str());
+
+    std::ostringstream values;
+    std::ostringstream loaded_values;
+    original.PrintValues(values);
+    loaded.PrintValues(loaded_values);
+    ASSERT(loaded_values.str() == values.str());
+
+    // Без перевода строки в конце
+    Sheet tail;
+    std::istringstream tail_input("1\t\t=A1+1\n\nx\t=C1");
+    tail.LoadTexts(tail_input);
+    ASSERT_EQUAL(tail.GetPrintableSize(), (Size{3, 3}));
+    ASSERT_EQUAL(tail.GetCell("B3"_pos)->GetValue(), CellInterface::Value(2.0));
+}
+
+void TestSnapshot() {
+    Sheet original;
+    FillFormulaGrid(original, 30, 200);
+    original.SetCell("B2"_pos, "'=escaped");
+    original.SetCell("C3"_pos, "same");
+    original.SetCell("D4"_pos, "same");
+    original.SetCell("ZZ40"_pos, "=-(+A1)/ZZ41*(B1-3)");
+    original.SetCell("ZZ41"_pos, "0");
+    original.SetCell("ZZ42"_pos, "=ZZ43");
+
+    std::ostringstream snapshot;
+    original.SaveSnapshot(snapshot);
+
+    Sheet loaded;
+    loaded.SetCell("A500"_pos, "replaced");
+    std::istringstream input(snapshot.str());
+    loaded.LoadSnapshot(input);
+
+    ASSERT_EQUAL(loaded.GetPrintableSize(), original.GetPrintableSize());
+    std::ostringstream texts, loaded_texts, values, loaded_values;
+    original.PrintTexts(texts);
+    loaded.PrintTexts(loaded_texts);
+    ASSERT(loaded_texts.str() == texts.str());
+    original.PrintValues(values);
+    loaded.PrintValues(loaded_values);
+    ASSERT(loaded_values.str() == values.str());
+
+    // Зависимости восстановлены вместе с формулами
+    loaded.SetCell("ZZ41"_pos, "2");
+    ASSERT(std::holds_alternative<double>(loaded.GetCell("ZZ40"_pos)->GetValue()));
+    ASSERT_EQUAL(loaded.GetCell("ZZ40"_pos)->GetText(), original.GetCell("ZZ40"_pos)->GetText());
+    try {
+        loaded.SetCell("ZZ43"_pos, "=ZZ42");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+
+    // Любой испорченный байт обнаруживается, лист при этом не меняется
+    const std::string data = snapshot.str();
+    for (size_t i = 0; i < data.size(); i += 97) {
+        std::string corrupted = data;
+        corrupted[i] ^= 0x20;
+        std::istringstream corrupted_input(corrupted);
+        try {
+            loaded.LoadSnapshot(corrupted_input);
+            ASSERT(false);
+        } catch (const SnapshotException&) {
+        }
+        ASSERT(loaded.GetCell("ZZ41"_pos)->GetText() == "2");
+    }
+
+    std::istringstream truncated(data.substr(0, data.size() / 2));
+    try {
+        loaded.LoadSnapshot(truncated);
+        ASSERT(false);
+    } catch (const SnapshotException&) {
+    }
+}
+
+void TestMapSnapshot() {
+    Sheet original;
+    FillFormulaGrid(original, 150, 200);
+    original.SetCell("B2000"_pos, "=C3000");
+    original.SetCell("C3000"_pos, "=D4000*2");
+    original.SetCell("D4000"_pos, "5");
+    original.SetCell("E1000"_pos, "=SUM(F3000:G3100)");
+    original.SetCell("G3050"_pos, "=D4000+1");
+
+    std::ostringstream snapshot;
+    original.SaveSnapshot(snapshot);
+    const std::string data = snapshot.str();
+    const auto path = (std::filesystem::temp_directory_path() / "spreadsheet_test.snapshot").string();
+    std::ofstream(path, std::ios::binary) << data;
+
+    Sheet mapped;
+    mapped.SetCell("A1"_pos, "replaced");
+    mapped.MapSnapshot(path);
+    ASSERT_EQUAL(mapped.GetPrintableSize(), original.GetPrintableSize());
+
+    // Тайл переносится вместе с тайлами, от которых зависят его формулы
+    ASSERT_EQUAL(mapped.GetCell("B2000"_pos)->GetValue(), CellInterface::Value(10.0));
+    ASSERT_EQUAL(mapped.GetCell("E1000"_pos)->GetValue(), CellInterface::Value(6.0));
+    try {
+        mapped.SetCell("D4000"_pos, "=E1000");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+    ASSERT_EQUAL(mapped.GetCell("GR150"_pos)->GetValue(), original.GetCell("GR150"_pos)->GetValue());
+    try {
+        mapped.SetCell("D4000"_pos, "=B2000");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+
+    for (Sheet* sheet : {&original, &mapped}) {
+        sheet->SetCell("GS149"_pos, "7");
+        sheet->ClearCell("A150"_pos);
+    }
+    std::ostringstream texts, mapped_texts, values, mapped_values;
+    original.PrintTexts(texts);
+    mapped.PrintTexts(mapped_texts);
+    ASSERT(mapped_texts.str() == texts.str());
+    original.PrintValues(values);
+    mapped.PrintValues(mapped_values);
+    ASSERT(mapped_values.str() == values.str());
+
+    // Повреждённый тайл обнаруживается только при обращении к нему. Последний
+    // блок тайла, с ячейкой D4000, заканчивается перед таблицей строк.
+    snapshot::Reader header(std::string_view(data).substr(16));
+    std::string corrupted = data;
+    corrupted[header.GetU64() - 1] ^= 0x20;
+    std::ofstream(path, std::ios::binary) << corrupted;
+
+    Sheet damaged;
+    damaged.MapSnapshot(path);
+    ASSERT_EQUAL(damaged.GetCell("A2"_pos)->GetValue(), original.GetCell("A2"_pos)->GetValue());
+    try {
+        damaged.GetCell("B2000"_pos);
+        ASSERT(false);
+    } catch (const SnapshotException&) {
+    }
+
+    // Повреждённый текст обнаруживается только при переносе его тайла, тексты
+    // других тайлов не проверяются и не читаются
+    snapshot::Reader strings(std::string_view(data).substr(16));
+    const size_t text_offset = data.find("=D4000+1", strings.GetU64());
+    ASSERT(text_offset != std::string::npos);
+    corrupted = data;
+    corrupted[text_offset + 1] ^= 0x20;
+    std::ofstream(path, std::ios::binary) << corrupted;
+
+    Sheet damaged_strings;
+    damaged_strings.MapSnapshot(path);
+    ASSERT_EQUAL(damaged_strings.GetCell("A2"_pos)->GetValue(), original.GetCell("A2"_pos)->GetValue());
+    ASSERT_EQUAL(damaged_strings.GetCell("B2000"_pos)->GetValue(), CellInterface::Value(10.0));
+    try {
+        damaged_strings.GetCell("G3050"_pos);
+        ASSERT(false);
+    } catch (const SnapshotException&) {
+    }
+
+    std::filesystem::remove(path);
+}
+
+// Описание результата разбора, одинаковое для обоих парсеров, если они
+// строят одинаковые деревья и отвергают одни и те же формулы
+template <typename Parser>
+std::string DescribeParse(Parser parse, const std::string& expression) {
+    try {
+        const FormulaAST ast = parse(expression);
+        std::ostringstream out;
+        ast.Print(out);
+        out << " | ";
+        ast.PrintCells(out);
+        out << "| ";
+        ast.PrintFormula(out);
+        return out.str();
+    } catch (const FormulaException&) {
+        return "#position";
+    } catch (const std::exception&) {
+        return "#syntax";
+    }
+}
+
+void TestFormulaParserMatchesAntlr() {
+    auto check = [](const std::string& expression) {
+        const auto direct = DescribeParse([](const std::string& e) { return ParseFormulaAST(e); }, expression);
+        const auto antlr = DescribeParse([](const std::string& e) { return ParseFormulaASTAntlr(e); }, expression);
+        const std::string context = " for \"" + expression + "\"";
+        ASSERT_EQUAL(direct + context, antlr + context);
+    };
+
+    for (const std::string expression : {
+             "1", " 42 ", "2 + 2*2", "(12+13) * (14+(13-24/(1+1))*55-46)", "-A1*B1", "--1", "+-+A1",
+             "1-2-3", "1/2/3", "1-(2-3)", "2*-3", "-(A1+B2)", "A1+A2+A1", "1.5e3", ".5", "1E+2",
+             "1e-400", "1e400", "XFD16384", "1.", "1e", "A", "A2B", "3X", "A0++", "((1)", "2+4-", "",
+             "()", "1 2", "X0", "ABCD1", "R2D2", "XFD16385", "1+ABCD1+(", "a1", "1..2", "1.2.3", "E5",
+             // функции и диапазоны
+             "SUM(A1:B2)", "SUM(B2:A1)", "SUM(A1, B2:C3, 4)", "AVERAGE(A1:A3)*2", "-MIN(1, 2)+MAX(A1:B1)",
+             "COUNT(A1 : B2)", "SUM(SUM(A1:B2), 1)", "SUM((A1+1))", "SUM(A1:B2:C3)", "SUM(A1:)", "SUM()",
+             "SUM(1,)", "SUM", "SUM 1", "FOO(1)", "A1:B2", "A1:B2+1", "SUM(A1:1)", "SUM(1:A1)",
+             "SUM(A0:B1)", "SUM(A1:XFD16385)", "XFD16385+FOO(1)", "SUM(XFD16385, 1e400)",
+             "SUM(1e400, A1:A0)", "(SUM)(1)",
+         }) {
+        check(expression);
+    }
+
+    // Случайные последовательности лексем, в основном некорректные
+    const std::vector<std::string> pieces = {
+        "A1", "B2", "ZZ9", "XFD16385", "1", "2.5", ".5", "1e3", "1E+2", "1e", "1.", "+", "-",
+        "*", "/", "(", ")", " ", "E", "e", "3", "A", "\t", "SUM(", "MAX(", "FOO(", ":", ",",
+    };
+    std::mt19937 generator(2024);
+    std::uniform_int_distribution<size_t> piece(0, pieces.size() - 1);
+    std::uniform_int_distribution<int> length(1, 8);
+    for (int i = 0; i < 5000; ++i) {
+        std::string expression;
+        for (int j = length(generator); j > 0; --j) {
+            expression += pieces[piece(generator)];
+        }
+        check(expression);
+    }
+}
+
+//_______Бенчмарки_______
+
+std::vector<Position> MakeRandomPositions(size_t count) {
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> row(0, Position::MAX_ROWS - 1);
+    std::uniform_int_distribution<int> col(0, 1023);
+
+    std::vector<Position> positions(count);
+    for (auto& pos : positions) {
+        pos = {row(generator), col(generator)};
+    }
+    return positions;
+}
+
+void BenchPositionIndex() {
+    // Прежний индекс листа: строковое представление позиции под std::hash
+    struct StringPositionHasher {
+        size_t operator()(Position p) const {
+            return std::hash<std::string>()(p.ToString());
+        }
+    };
+
+    const auto positions = MakeRandomPositions(1 << 20);
+    const int passes = 4;
+    double checksum = 0;
+
+    std::unordered_map<Position, int, StringPositionHasher> string_map;
+    FlatHashMap<int> flat_map;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        string_map[positions[i]] = static_cast<int>(i);
+        flat_map[PackPosition(positions[i])] = static_cast<int>(i);
+    }
+
+    {
+        LOG_DURATION("unordered_map<Position, string hash> lookups");
+        for (int pass = 0; pass < passes; ++pass) {
+            for (Position pos : positions) {
+                checksum += string_map.find(pos)->second;
+            }
+        }
+    }
+    {
+        LOG_DURATION("FlatHashMap<PositionKey> lookups");
+        for (int pass = 0; pass < passes; ++pass) {
+            for (Position pos : positions) {
+                checksum += *flat_map.Find(PackPosition(pos));
+            }
+        }
+    }
+
+    std::cerr << "checksum: " << checksum << std::endl;
+}
+
+void BenchFormulaParser() {
+    std::vector<std::string> formulas;
+    for (int row = 1; row <= Position::MAX_ROWS; ++row) {
+        const auto r = std::to_string(row);
+        formulas.push_back("A" + r + "*B" + r + "+(C" + r + "-1.5)/2");
+    }
+
+    size_t cells = 0;
+    {
+        LOG_DURATION("ANTLR formula parser");
+        for (const auto& formula : formulas) {
+            cells += !ParseFormulaASTAntlr(formula).GetReferencedCells().empty();
+        }
+    }
+    {
+        LOG_DURATION("Direct formula parser");
+        for (const auto& formula : formulas) {
+            cells += !ParseFormulaAST(formula).GetReferencedCells().empty();
+        }
+    }
+
+    std::cerr << "checksum: " << cells << std::endl;
+}
+
+void BenchPrintValues() {
+    Sheet sheet;
+    std::vector<std::pair<Position, std::string>> batch;
+    for (int row = 0; row < 5000; ++row) {
+        for (int col = 0; col < 200; ++col) {
+            batch.emplace_back(Position{row, col}, "=" + std::to_string((row * 7919 + col) % 100003) + "/7");
+        }
+    }
+    sheet.ApplyBatch(std::move(batch));
+    sheet.Recalculate();
+
+    size_t size = 0;
+    {
+        // Прежний вывод: каждое значение через std::visit и operator<< потока
+        LOG_DURATION("PrintValues through ostream operator<<");
+        std::ostringstream output;
+        for (int row = 0; row < 5000; ++row) {
+            for (int col = 0; col < 200; ++col) {
+                if (col > 0) {
+                    output << '\t';
+                }
+                std::visit([&output](const auto& value) { output << value; },
+                           sheet.GetCell(Position{row, col})->GetValue());
+            }
+            output << '\n';
+        }
+        size += output.str().size();
+    }
+    {
+        LOG_DURATION("PrintValues through BufferedWriter");
+        std::ostringstream output;
+        sheet.PrintValues(output);
+        size += output.str().size();
+    }
+
+    std::cerr << "checksum: " << size << std::endl;
+}
+
+void BenchFormulaInputReads() {
+    const int inputs = 20;
+    const int evaluations = 200000;
+
+    Sheet sheet;
+    for (int row = 0; row < inputs; ++row) {
+        sheet.SetCell(Position{row, 0}, std::to_string(1e15 + row));
+    }
+    const auto formula = ParseFormula(MakeSumOfColumn(inputs));
+    ForwardingSheet generic(sheet);
+
+    double checksum = 0;
+    for (const auto& [name, target] : {std::pair<std::string, const SheetInterface*>{"GetValue reads", &generic},
+                                       std::pair<std::string, const SheetInterface*>{"typed reads", &sheet}}) {
+        LOG_DURATION("Formula inputs through " + name);
+        for (int i = 0; i < evaluations; ++i) {
+            checksum += std::get<double>(formula->Evaluate(*target));
+        }
+    }
+
+    std::cerr << "checksum: " << checksum << std::endl;
+}
+
+void BenchErrorHeavyEvaluation() {
+    const int inputs = 20;
+    const int evaluations = 200000;
+
+    const auto formula = ParseFormula(MakeSumOfColumn(inputs));
+    double checksum = 0;
+    for (const auto& [name, input] : {std::pair{"numbers"s, "1"s}, std::pair{"#VALUE! inputs"s, "text"s},
+                                      std::pair{"#ARITHM! inputs"s, "=1/0"s}}) {
+        Sheet sheet;
+        for (int row = 0; row < inputs; ++row) {
+            sheet.SetCell(Position{row, 0}, input);
+        }
+
+        LOG_DURATION("Formula evaluation over " + name);
+        for (int i = 0; i < evaluations; ++i) {
+            const auto value = formula->Evaluate(sheet);
+            checksum += std::holds_alternative<double>(value) ? std::get<double>(value) : 1;
+        }
+    }
+
+    std::cerr << "checksum: " << checksum << std::endl;
+}
+
+void BenchPaddedFormula() {
+    const int evaluations = 1000000;
+
+    Sheet sheet;
+    sheet.SetCell("A1"_pos, "3");
+    sheet.SetCell("A2"_pos, "4");
+    // Формула в духе шаблонов: константные множители и нулевые слагаемые
+    const auto formula = ParseFormula("(A1*1-0)*(2*3)/1+--A2*(10/5)-(1-1)+1*A1*(1+1)/2");
+
+    double checksum = 0;
+    {
+        LOG_DURATION("Padded formula evaluation");
+        for (int i = 0; i < evaluations; ++i) {
+            checksum += std::get<double>(formula->Evaluate(sheet));
+        }
+    }
+    std::cerr << "checksum: " << checksum << std::endl;
+}
+
+// Память, занятая в куче, или 0, если её нельзя узнать
+size_t GetHeapInUse() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+void BenchFilledColumn() {
+    const int rows = Position::MAX_ROWS;
+
+    std::vector<std::pair<Position, std::string>> inputs, formulas;
+    for (int row = 0; row < rows; ++row) {
+        const std::string r = std::to_string(row + 1);
+        inputs.push_back({Position{row, 0}, r});
+        inputs.push_back({Position{row, 1}, "2"});
+        formulas.push_back({Position{row, 2}, "=A" + r + "*B" + r + "+1"});
+    }
+
+    Sheet sheet;
+    sheet.ApplyBatch(std::move(inputs));
+    const size_t heap_before = GetHeapInUse();
+    {
+        LOG_DURATION("Filled-down column of " + std::to_string(rows) + " formulas");
+        sheet.ApplyBatch(std::move(formulas));
+        sheet.Recalculate(1);
+    }
+    const size_t heap_after = GetHeapInUse();
+    std::cerr << "heap per formula cell: " << static_cast<double>(heap_after - heap_before) / rows << " bytes" << std::endl;
+}
+
+void BenchColumnRecalculate() {
+    const int rows = Position::MAX_ROWS;
+    const int repeats = 20;
+
+    Sheet sheet;
+    std::vector<std::pair<Position, std::string>> formulas;
+    for (int row = 0; row < rows; ++row) {
+        const std::string r = std::to_string(row + 1);
+        formulas.push_back({Position{row, 3}, "=A" + r + "*B" + r + "+C" + r});
+        formulas.push_back({Position{row, 4}, "=(D" + r + "-A" + r + ")/2"});
+    }
+    sheet.ApplyBatch(std::move(formulas));
+
+    // Берётся лучшее время: на общей машине среднее сильно шумит
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int i = 0; i < repeats; ++i) {
+        std::vector<std::pair<Position, std::string>> inputs;
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                inputs.push_back({Position{row, col}, std::to_string(row + col + i)});
+            }
+        }
+        sheet.ApplyBatch(std::move(inputs));
+
+        const auto start = std::chrono::steady_clock::now();
+        sheet.Recalculate(1);
+        best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    std::cerr << "Recalculate of 2 computed columns x " << rows << " rows: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(best).count() << " us" << std::endl;
+}
+
+void BenchRangeSum() {
+    const int inputs = 500;
+    const int totals = 200;
+    const int updates = 50;
+
+    // Одни и те же итоги записаны сложениями ячеек и функцией от области
+    for (const auto& [name, formula] : {std::pair{"chain"s, "="s + MakeSumOfColumn(inputs)},
+                                        std::pair{"SUM"s, "=SUM(A1:A"s + std::to_string(inputs) + ")"}}) {
+        Sheet sheet;
+        for (int row = 0; row < inputs; ++row) {
+            sheet.SetCell(Position{row, 0}, std::to_string(row));
+        }
+
+        double checksum = 0;
+        {
+            LOG_DURATION("Set " + std::to_string(totals) + " totals of " + std::to_string(inputs) + " cells, " + name);
+            for (int row = 0; row < totals; ++row) {
+                sheet.SetCell(Position{row, 2}, formula);
+            }
+        }
+        {
+            LOG_DURATION("Update an input and recalculate " + std::to_string(updates) + " times, " + name);
+            for (int i = 0; i < updates; ++i) {
+                sheet.SetCell(Position{i, 0}, std::to_string(i * 2));
+                sheet.Recalculate(1);
+                checksum += std::get<double>(sheet.GetCell(Position{totals - 1, 2})->GetValue());
+            }
+        }
+        std::cerr << "checksum: " << checksum << std::endl;
+    }
+}
+
+void BenchRangeDependents() {
+    const int rows = Position::MAX_ROWS;
+    const int window = 10;
+    const int edits = 4000;
+
+    Sheet sheet;
+    std::vector<std::pair<Position, std::string>> inputs;
+    for (int row = 0; row < rows; ++row) {
+        inputs.push_back({Position{row, 0}, std::to_string(row)});
+    }
+    sheet.ApplyBatch(std::move(inputs));
+
+    {
+        LOG_DURATION("Set " + std::to_string(rows) + " window sums one by one");
+        for (int row = 0; row < rows; ++row) {
+            sheet.SetCell(Position{row, 1}, "=SUM(A" + std::to_string(row + 1) + ":A"
+                                               + std::to_string(std::min(row + window, rows)) + ")");
+        }
+        sheet.SetCell(Position{0, 3}, "=SUM(A1:A" + std::to_string(rows) + ")");
+    }
+
+    double checksum = 0;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> row(0, rows - 1);
+    {
+        LOG_DURATION("Edit " + std::to_string(edits) + " cells inside and outside the ranges");
+        for (int i = 0; i < edits; ++i) {
+            sheet.SetCell(Position{row(generator), i % 2 == 0 ? 0 : 2}, std::to_string(i));
+        }
+        sheet.Recalculate(1);
+        checksum += std::get<double>(sheet.GetCell(Position{0, 3})->GetValue());
+    }
+    std::cerr << "checksum: " << checksum << std::endl;
+}
+
+void BenchSumIndex() {
+    const int rows = 10000;
+    const int cols = 20;
+    const int windows = 400;
+    const int updates = 10;
+
+    // Перекрывающиеся окна по большому блоку чисел с индексом сумм и без
+    for (const bool use_index : {false, true}) {
+        const std::string name = use_index ? "sum index" : "scan";
+        Sheet sheet;
+        if (use_index) {
+            sheet.SetSumIndexRegion(Range{{0, 0}, {rows - 1, cols - 1}});
+        }
+        std::vector<std::pair<Position, std::string>> inputs;
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                inputs.push_back({Position{row, col}, std::to_string(row % 100 + col)});
+            }
+        }
+        {
+            LOG_DURATION("Load " + std::to_string(rows) + "x" + std::to_string(cols) + " numbers, " + name);
+            sheet.ApplyBatch(std::move(inputs));
+        }
+
+        std::vector<std::pair<Position, std::string>> totals;
+        for (int i = 0; i < windows; ++i) {
+            const Position first{i * 10, i % 10};
+            const Position last{i * 10 + rows / 2 - 1, i % 10 + cols / 2 - 1};
+            totals.push_back({Position{i, cols + 1}, "=SUM(" + first.ToString() + ":" + last.ToString() + ")"});
+        }
+        sheet.ApplyBatch(std::move(totals));
+
+        double checksum = 0;
+        {
+            LOG_DURATION("Evaluate " + std::to_string(windows) + " SUM windows, " + name);
+            sheet.Recalculate(1);
+        }
+        {
+            LOG_DURATION("Update an input and recalculate " + std::to_string(updates) + " times, " + name);
+            for (int i = 0; i < updates; ++i) {
+                sheet.SetCell(Position{rows / 2, i % cols}, std::to_string(i));
+                sheet.Recalculate(1);
+                checksum += std::get<double>(sheet.GetCell(Position{windows - 1, cols + 1})->GetValue());
+            }
+        }
+        std::cerr << "checksum: " << checksum << std::endl;
+    }
+}
+
+void RunBenchmarks() {
+    BenchPositionIndex();
+    BenchFormulaParser();
+    BenchPrintValues();
+    BenchFormulaInputReads();
+    BenchErrorHeavyEvaluation();
+    BenchPaddedFormula();
+    BenchFilledColumn();
+    BenchColumnRecalculate();
+    BenchRangeSum();
+    BenchRangeDependents();
+    BenchSumIndex();
+}
 }  // namespace
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        RunBenchmarks();
+        return 0;
+    }
+
     TestRunner tr;
     RUN_TEST(tr, TestPositionAndStringConversion);
     RUN_TEST(tr, TestPositionToStringInvalid);
@@ -378,6 +2094,7 @@ int main() {
     RUN_TEST(tr, TestFormulaReferencedCells);
     RUN_TEST(tr, TestErrorValue);
     RUN_TEST(tr, TestErrorArithmetic);
+    RUN_TEST(tr, TestErrorPropagationOrder);
     RUN_TEST(tr, TestEmptyCellTreatedAsZero);
     RUN_TEST(tr, TestFormulaInvalidPosition);
     RUN_TEST(tr, TestPrint);
@@ -385,4 +2102,31 @@ int main() {
     RUN_TEST(tr, TestFormulaIncorrect);
     RUN_TEST(tr, TestCellCircularReferences);
     RUN_TEST(tr, TestClearPrint);
+    RUN_TEST(tr, TestCellStorageTiles);
+    RUN_TEST(tr, TestFlatHashMap);
+    RUN_TEST(tr, TestRangeIndex);
+    RUN_TEST(tr, TestPrintSparse);
+    RUN_TEST(tr, TestSharedFormulas);
+    RUN_TEST(tr, TestBufferedWriterNumbers);
+    RUN_TEST(tr, TestParseNumberMatchesStream);
+    RUN_TEST(tr, TestTypedReadsMatchGetValue);
+    RUN_TEST(tr, TestPrintValuesToFd);
+    RUN_TEST(tr, TestExportValues);
+    RUN_TEST(tr, TestRangeConversion);
+    RUN_TEST(tr, TestRangeValues);
+    RUN_TEST(tr, TestFormulaProgramDeepNesting);
+    RUN_TEST(tr, TestFormulaParserMatchesAntlr);
+    RUN_TEST(tr, TestFormulaSimplification);
+    RUN_TEST(tr, TestInvalidateDiamondLayers);
+    RUN_TEST(tr, TestCircularReferencesAfterReordering);
+    RUN_TEST(tr, TestParallelRecalculate);
+    RUN_TEST(tr, TestColumnEvaluation);
+    RUN_TEST(tr, TestRangeFunctions);
+    RUN_TEST(tr, TestRangeDependencies);
+    RUN_TEST(tr, TestSumIndex);
+    RUN_TEST(tr, TestLongDependencyChain);
+    RUN_TEST(tr, TestApplyBatch);
+    RUN_TEST(tr, TestLoadTexts);
+    RUN_TEST(tr, TestSnapshot);
+    RUN_TEST(tr, TestMapSnapshot);
 }
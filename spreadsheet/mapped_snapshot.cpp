@@ -0,0 +1,156 @@
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_snapshot.h"
+
+namespace {
+// Отображает файл path в память целиком только для чтения. Отображение
+// остаётся действительным и после закрытия файла.
+std::string_view MapFile(const std::string& path) {
+#ifdef _WIN32
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw SnapshotException("Cannot open snapshot file " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(snapshot::HEADER_SIZE)) {
+        CloseHandle(file);
+        throw SnapshotException("Not a sheet snapshot");
+    }
+
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        throw SnapshotException("Cannot map snapshot file " + path);
+    }
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+        throw SnapshotException("Cannot map snapshot file " + path);
+    }
+    return std::string_view(static_cast<const char*>(data), static_cast<size_t>(file_size.QuadPart));
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw SnapshotException("Cannot open snapshot file " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(snapshot::HEADER_SIZE)) {
+        close(fd);
+        throw SnapshotException("Not a sheet snapshot");
+    }
+
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw SnapshotException("Cannot map snapshot file " + path);
+    }
+    return std::string_view(static_cast<const char*>(data), size);
+#endif
+}
+
+void UnmapFile(std::string_view data) {
+#ifdef _WIN32
+    UnmapViewOfFile(data.data());
+#else
+    munmap(const_cast<char*>(data.data()), data.size());
+#endif
+}
+}  // namespace
+
+MappedSnapshot::MappedSnapshot(const std::string& path)
+    : data_(MapFile(path)) {
+    try {
+        header_ = snapshot::ReadHeader(data_);
+        const std::string_view body = snapshot::ReadBody(data_, header_);
+        directory_ = body.substr(0, std::uint64_t{header_.tile_count} * snapshot::TILE_ENTRY_SIZE);
+        print_area_ = body.substr(directory_.size());
+        strings_ = snapshot::Slice(data_, header_.strings_offset, header_.strings_size);
+    } catch (...) {
+        UnmapFile(data_);
+        throw;
+    }
+
+    loaded_.resize(header_.tile_count);
+}
+
+MappedSnapshot::~MappedSnapshot() {
+    UnmapFile(data_);
+}
+
+std::optional<size_t> MappedSnapshot::FindTile(PositionKey key) const {
+    // Каталог отсортирован по ключу, ищем двоичным поиском прямо в отображении
+    size_t begin = 0;
+    size_t end = header_.tile_count;
+    while (begin < end) {
+        const size_t middle = begin + (end - begin) / 2;
+        const PositionKey middle_key = GetTile(middle).key;
+        if (middle_key == key) {
+            return middle;
+        }
+        if (middle_key < key) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return std::nullopt;
+}
+
+size_t MappedSnapshot::GetTileCount() const {
+    return header_.tile_count;
+}
+
+snapshot::TileEntry MappedSnapshot::GetTile(size_t index) const {
+    snapshot::Reader in(directory_.substr(index * snapshot::TILE_ENTRY_SIZE, snapshot::TILE_ENTRY_SIZE));
+    return snapshot::ReadTileEntry(in);
+}
+
+std::string_view MappedSnapshot::GetTileBlock(size_t index) const {
+    return snapshot::ReadTileBlock(data_, GetTile(index), strings_);
+}
+
+std::string_view MappedSnapshot::GetStrings() const {
+    return strings_;
+}
+
+std::string_view MappedSnapshot::GetPrintArea() const {
+    return print_area_;
+}
+
+bool MappedSnapshot::IsLoaded(size_t index) const {
+    return loaded_[index];
+}
+
+void MappedSnapshot::SetLoaded(size_t index, bool loaded) {
+    if (loaded_[index] == loaded) {
+        return;
+    }
+
+    loaded_[index] = loaded;
+    if (loaded) {
+        ++loaded_count_;
+    } else {
+        --loaded_count_;
+    }
+}
+
+bool MappedSnapshot::AllLoaded() const {
+    return loaded_count_ == loaded_.size();
+}
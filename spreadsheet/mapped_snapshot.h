@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_hash_map.h"
+#include "snapshot_format.h"
+
+// Файл снимка, отображённый в память. Конструктор проверяет только
+// заголовок, каталог и область печати; блок тайла и тексты его ячеек
+// читаются и проверяются при обращении к тайлу, поэтому в памяти оказываются
+// лишь страницы прочитанных тайлов и их текстов. Объект также помнит, какие тайлы уже
+// перенесены в лист.
+class MappedSnapshot {
+public:
+    // Бросает SnapshotException, если файл не открывается или повреждён
+    explicit MappedSnapshot(const std::string& path);
+    ~MappedSnapshot();
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    // Номер тайла с ключом key в каталоге или nullopt, если в снимке его нет
+    std::optional<size_t> FindTile(PositionKey key) const;
+    size_t GetTileCount() const;
+    snapshot::TileEntry GetTile(size_t index) const;
+    // Блок тайла, проверенный вместе с текстами его ячеек. Бросает
+    // SnapshotException, если тайл или его тексты повреждены.
+    std::string_view GetTileBlock(size_t index) const;
+
+    // Таблица строк без проверки: тексты проверяются по тайлам в GetTileBlock
+    std::string_view GetStrings() const;
+    std::string_view GetPrintArea() const;
+
+    bool IsLoaded(size_t index) const;
+    void SetLoaded(size_t index, bool loaded);
+    bool AllLoaded() const;
+
+private:
+    std::string_view data_;
+    snapshot::Header header_;
+    std::string_view directory_;
+    std::string_view print_area_;
+    std::string_view strings_;
+    std::vector<bool> loaded_;
+    size_t loaded_count_ = 0;
+};
@@ -0,0 +1,51 @@
+#include "range_index.h"
+
+void RangeIndex::Add(Range range, Cell* cell) {
+    ForEachNode(range, [&](std::uint32_t key) {
+        nodes_[key].push_back({range, cell});
+    });
+    ++size_;
+}
+
+void RangeIndex::Remove(Range range, Cell* cell) {
+    bool removed = false;
+    ForEachNode(range, [&](std::uint32_t key) {
+        auto* entries = nodes_.Find(key);
+        if (!entries) {
+            return;
+        }
+
+        for (auto& entry : *entries) {
+            if (entry.range == range && entry.cell == cell) {
+                entry = entries->back();
+                entries->pop_back();
+                removed = true;
+                break;
+            }
+        }
+        if (entries->empty()) {
+            nodes_.Erase(key);
+        }
+    });
+
+    if (removed) {
+        --size_;
+    }
+}
+
+void RangeIndex::Clear() {
+    nodes_ = FlatHashMap<std::vector<Entry>>{};
+    size_ = 0;
+}
+
+bool RangeIndex::IsEmpty() const {
+    return size_ == 0;
+}
+
+size_t RangeIndex::Size() const {
+    return size_;
+}
+
+std::uint32_t RangeIndex::NodeKey(int band, int node) {
+    return (static_cast<std::uint32_t>(band) << NODE_BITS) | static_cast<std::uint32_t>(node);
+}
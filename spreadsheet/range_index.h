@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+#include "flat_hash_map.h"
+
+class Cell;
+
+// Индекс областей, переданных функциям формул: по позиции находит формулы,
+// области которых её содержат. Столбцы листа разбиты на полосы по
+// BAND_SIZE, строки каждой полосы покрывает дерево отрезков. Область
+// хранится в узлах, на которые раскладывается её отрезок строк, - не больше
+// 2 * log2(MAX_ROWS) узлов в каждой задетой полосе. Запрос проходит путь от
+// листа строки до корня в дереве полосы столбца, поэтому не зависит ни от
+// числа областей, ни от их размера: ссылка на весь столбец занимает один
+// корневой узел.
+class RangeIndex {
+public:
+    void Add(Range range, Cell* cell);
+    void Remove(Range range, Cell* cell);
+    void Clear();
+
+    bool IsEmpty() const;
+    size_t Size() const;
+
+    // Вызывает func(cell) для каждой формулы, область которой содержит
+    // pos, - по разу на каждую такую область
+    template <typename Func>
+    void ForEachContaining(Position pos, Func func) const;
+
+private:
+    static const int BAND_SHIFT = 6;
+    // Узлы дерева нумеруются как в куче: корень 1, дети узла k - 2k и 2k + 1,
+    // лист строки row - ROW_LEAVES + row. Номер узла занимает NODE_BITS бит.
+    static const int ROW_LEAVES = Position::MAX_ROWS;
+    static const int NODE_BITS = 15;
+
+    struct Entry {
+        Range range;
+        Cell* cell;
+    };
+
+    FlatHashMap<std::vector<Entry>> nodes_;
+    size_t size_ = 0;
+
+    static std::uint32_t NodeKey(int band, int node);
+
+    // Вызывает func(key) для ключей узлов, в которых хранится область
+    template <typename Func>
+    static void ForEachNode(Range range, Func func);
+};
+
+template <typename Func>
+void RangeIndex::ForEachContaining(Position pos, Func func) const {
+    if (size_ == 0) {
+        return;
+    }
+
+    const int band = pos.col >> BAND_SHIFT;
+    for (int node = ROW_LEAVES + pos.row; node > 0; node >>= 1) {
+        const auto* entries = nodes_.Find(NodeKey(band, node));
+        if (!entries) {
+            continue;
+        }
+
+        // Строки записей узла на пути к листу содержат pos.row
+        for (const auto& entry : *entries) {
+            if (entry.range.first.col <= pos.col && pos.col <= entry.range.last.col) {
+                func(entry.cell);
+            }
+        }
+    }
+}
+
+template <typename Func>
+void RangeIndex::ForEachNode(Range range, Func func) {
+    for (int band = range.first.col >> BAND_SHIFT; band <= range.last.col >> BAND_SHIFT; ++band) {
+        // Отрезок строк [first, last] раскладывается снизу вверх: узел
+        // берётся целиком, если его родитель выходит за границу отрезка
+        int lower = ROW_LEAVES + range.first.row;
+        int upper = ROW_LEAVES + range.last.row + 1;
+        for (; lower < upper; lower >>= 1, upper >>= 1) {
+            if (lower & 1) {
+                func(NodeKey(band, lower++));
+            }
+            if (upper & 1) {
+                func(NodeKey(band, --upper));
+            }
+        }
+    }
+}
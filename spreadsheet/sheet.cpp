@@ -1,70 +1,322 @@
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <optional>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
 
+#include "buffered_writer.h"
 #include "cell.h"
 #include "common.h"
+#include "mapped_snapshot.h"
 #include "sheet.h"
 
 using namespace std::literals;
 
+namespace {
+
+void WriteValue(BufferedWriter& writer, const Cell::ValueView& value) {
+    if(const double* number = std::get_if<double>(&value)) {
+        writer.WriteNumber(*number);
+    } else if(const std::string_view* text = std::get_if<std::string_view>(&value)) {
+        writer.Write(*text);
+    } else {
+        writer.Write(std::get<FormulaError>(value).ToString());
+    }
+}
+
+// Вклад ячейки в индекс сумм: число, которое она отдаёт функциям
+// областей, или признак формулы, значение которой индекс не хранит
+SumIndex::Totals GetSumTotals(const Cell* cell) {
+    SumIndex::Totals totals;
+    if(!cell) {
+        return totals;
+    }
+    if(cell->GetFormula()) {
+        totals.formulas = 1;
+    } else if(const auto value = cell->GetRangeValue()) {
+        totals = SumIndex::FromNumber(std::get<double>(*value));
+    }
+    return totals;
+}
+
+}  // namespace
+
+Sheet::Sheet() = default;
+
 Sheet::~Sheet() = default;
 
 void Sheet::SetCell(Position pos, std::string text) {
     ThrowIfNotValid(pos);
     
-    const auto& cell = sheet_.find(pos);
-    if (cell == sheet_.end()) {
-        sheet_.emplace(pos, std::make_unique<Cell>(*this));
+    Cell::Content content = Cell::Parse(std::move(text), pos, *this);
+    Cell* cell = FindCell(pos);
+
+    // Зависимости от областей устанавливаются только пакетом
+    if(!content.GetReferencedRanges().empty() || (cell && !cell->GetReferencedRanges().empty())
+       || HasRangeDependents(pos)) {
+        std::vector<Cell::Content> contents;
+        contents.push_back(std::move(content));
+        ApplyContents({pos}, std::move(contents));
+        return;
     }
-    
-    sheet_.at(pos)->Set(std::move(text));
 
-    if(sheet_.at(pos)->GetText() != ""s) {
-        min_print_area_.AddCountPositions(pos);
+    if (!cell) {
+        cell = &cells_.Insert(pos, std::make_unique<Cell>(*this));
     }
+
+    const bool was_printable = !cell->IsEmpty();
+    const SumIndex::Totals before = GetSumTotals(cell);
+    cell->Set(std::move(content));
+    UpdatePrintArea(pos, was_printable, !cell->IsEmpty());
+    UpdateSumIndex(pos, before, cell);
 }
 
-const CellInterface* Sheet::GetCell(Position pos) const {
-    ThrowIfNotValid(pos);
-    
-    const auto cell = sheet_.find(pos);
-    if (cell == sheet_.end()) {
-        return nullptr;
+void Sheet::ApplyBatch(std::vector<std::pair<Position, std::string>> batch) {
+    for(const auto& [pos, text] : batch) {
+        ThrowIfNotValid(pos);
+    }
+
+    // Оставляем последнее значение для каждой позиции
+    std::stable_sort(batch.begin(), batch.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    batch.erase(batch.begin(), std::unique(batch.rbegin(), batch.rend(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+    }).base());
+
+    std::vector<Position> positions;
+    std::vector<Cell::Content> contents;
+    positions.reserve(batch.size());
+    contents.reserve(batch.size());
+    for(auto& [pos, text] : batch) {
+        positions.push_back(pos);
+        contents.push_back(Cell::Parse(std::move(text), pos, *this));
     }
 
-    return sheet_.at(pos).get();
+    ApplyContents(positions, std::move(contents));
 }
 
-CellInterface* Sheet::GetCell(Position pos) {
-    ThrowIfNotValid(pos);
+void Sheet::ApplyContents(const std::vector<Position>& positions, std::vector<Cell::Content> contents,
+                          bool update_print_area) {
+    // Ячейки, созданные пакетом, удаляются при откате
+    std::vector<Position> created;
+    const auto get_or_create = [this, &created](Position pos) {
+        Cell* cell = FindCell(pos);
+        if(!cell) {
+            cell = &cells_.Insert(pos, std::make_unique<Cell>(*this));
+            created.push_back(pos);
+        }
+        return cell;
+    };
+
+    std::vector<Cell*> cells;
+    std::vector<bool> was_printable;
+    std::vector<SumIndex::Totals> sum_totals;
+    // Области, которые ячейки пакета передавали функциям до него
+    std::vector<std::vector<Range>> old_ranges;
+    bool has_ranges = !range_dependents_.IsEmpty();
+    try {
+        for(const auto& pos : positions) {
+            cells.push_back(get_or_create(pos));
+            was_printable.push_back(!cells.back()->IsEmpty());
+            sum_totals.push_back(GetSumTotals(cells.back()));
+            old_ranges.push_back(cells.back()->GetReferencedRanges());
+        }
+
+        std::vector<std::vector<Cell*>> references(contents.size());
+        for(size_t i = 0; i < contents.size(); ++i) {
+            for(const auto& pos : contents[i].GetReferencedCells()) {
+                references[i].push_back(get_or_create(pos));
+            }
+            for(const auto& range : contents[i].GetReferencedRanges()) {
+                MaterializeRange(range);
+                has_ranges = true;
+            }
+        }
+
+        std::vector<Cell*> range_dependents;
+        if(has_ranges) {
+            AddRangeReferences(positions, cells, contents, references, range_dependents);
+        }
+
+        Cell::SetMany(cells, std::move(contents), references, range_dependents);
+    } catch(...) {
+        for(const auto& pos : created) {
+            cells_.Erase(pos);
+        }
+        throw;
+    }
+
+    for(size_t i = 0; i < positions.size(); ++i) {
+        for(const auto& range : old_ranges[i]) {
+            range_dependents_.Remove(range, cells[i]);
+        }
+        for(const auto& range : cells[i]->GetReferencedRanges()) {
+            range_dependents_.Add(range, cells[i]);
+        }
+        UpdateSumIndex(positions[i], sum_totals[i], cells[i]);
+    }
+
+    if(!update_print_area) {
+        return;
+    }
+    for(size_t i = 0; i < positions.size(); ++i) {
+        UpdatePrintArea(positions[i], was_printable[i], !cells[i]->IsEmpty());
+    }
+}
+
+void Sheet::AddRangeReferences(const std::vector<Position>& positions, std::vector<Cell*>& cells,
+                               std::vector<Cell::Content>& contents,
+                               std::vector<std::vector<Cell*>>& references,
+                               std::vector<Cell*>& range_dependents) const {
+    std::unordered_map<const Cell*, size_t> batch;
+    for(size_t i = 0; i < positions.size(); ++i) {
+        batch[cells[i]] = i;
+    }
+
+    // Ячейка пакета - формула, если формула её новое содержимое
+    const auto is_formula = [&](const Cell& cell) {
+        const auto it = batch.find(&cell);
+        return it == batch.end() ? cell.GetFormula() != nullptr : contents[it->second].IsFormula();
+    };
+    const auto add_formulas = [&](Range range, std::vector<Cell*>& referenced) {
+        cells_.ForEachInRange(range, [&](Position, Cell& cell) {
+            if(is_formula(cell)) {
+                referenced.push_back(&cell);
+            }
+        });
+    };
+
+    std::unordered_map<Cell*, bool> dependents;
+    for(size_t i = 0; i < positions.size(); ++i) {
+        for(const auto& range : contents[i].GetReferencedRanges()) {
+            add_formulas(range, references[i]);
+        }
+
+        const bool kind_changed = (cells[i]->GetFormula() != nullptr) != contents[i].IsFormula();
+        range_dependents_.ForEachContaining(positions[i], [&](Cell* dependent) {
+            if(!batch.count(dependent)) {
+                dependents[dependent] |= kind_changed;
+            }
+        });
+    }
+
+    // Ссылки формулы на ячейки области меняются, только если ячейка
+    // области стала формулой или перестала ею быть
+    for(const auto& [dependent, relink] : dependents) {
+        if(!relink) {
+            range_dependents.push_back(dependent);
+            continue;
+        }
 
-    const auto cell = sheet_.find(pos);
-    if (cell == sheet_.end()) {
-        return nullptr;
+        std::vector<Cell*> referenced;
+        for(const auto& pos : dependent->GetReferencedCells()) {
+            referenced.push_back(FindCell(pos));
+        }
+        for(const auto& range : dependent->GetReferencedRanges()) {
+            add_formulas(range, referenced);
+        }
+        cells.push_back(dependent);
+        contents.emplace_back();
+        references.push_back(std::move(referenced));
     }
+}
 
-    return sheet_.at(pos).get();
+bool Sheet::HasRangeDependents(Position pos) const {
+    bool found = false;
+    range_dependents_.ForEachContaining(pos, [&found](Cell*) {
+        found = true;
+    });
+    return found;
+}
+
+void Sheet::UpdateSumIndex(Position pos, const SumIndex::Totals& before, const Cell* cell) {
+    if(!sum_index_) {
+        return;
+    }
+
+    const SumIndex::Totals after = GetSumTotals(cell);
+    if(after.sum != before.sum || after.magnitude != before.magnitude || after.count != before.count
+       || after.inexact != before.inexact || after.formulas != before.formulas) {
+        sum_index_->Update(pos, before, after);
+    }
+}
+
+void Sheet::SetSumIndexRegion(std::optional<Range> region) {
+    if(!region) {
+        sum_index_.reset();
+        return;
+    }
+    ThrowIfNotValid(*region);
+
+    MaterializeRange(*region);
+    auto sum_index = std::make_unique<SumIndex>(*region);
+    cells_.ForEachInRange(*region, [&sum_index](Position pos, const Cell& cell) {
+        sum_index->Put(pos, GetSumTotals(&cell));
+    });
+    sum_index->Build();
+    sum_index_ = std::move(sum_index);
+}
+
+bool Sheet::TrySumRange(Range range, double& sum, double& count) const {
+    if(!sum_index_ || !sum_index_->GetRegion().Contains(range.first)
+       || !sum_index_->GetRegion().Contains(range.last)) {
+        return false;
+    }
+
+    const SumIndex::Totals totals = sum_index_->Query(range);
+    if(totals.formulas != 0 || totals.inexact != 0 || totals.magnitude > SumIndex::MAX_EXACT_MAGNITUDE) {
+        return false;
+    }
+    sum = static_cast<double>(totals.sum);
+    count = totals.count;
+    return true;
+}
+
+const CellInterface* Sheet::GetCell(Position pos) const {
+    return GetConcreteCell(pos);
+}
+
+CellInterface* Sheet::GetCell(Position pos) {
+    return GetConcreteCell(pos);
 }
 
 const Cell* Sheet::GetConcreteCell(Position pos) const {
-    return reinterpret_cast<const Cell*>(GetCell(pos));
+    ThrowIfNotValid(pos);
+    return FindCell(pos);
 }
 
 Cell *Sheet::GetConcreteCell(Position pos) {
-    return reinterpret_cast<Cell*>(GetCell(pos));
+    ThrowIfNotValid(pos);
+    return FindCell(pos);
 }
 
 void Sheet::ClearCell(Position pos) {
     ThrowIfNotValid(pos);
 
-    if(!CheckCurrentPosition(pos)) {
+    Cell* cell = FindCell(pos);
+    if(!cell) {
         return;
     }
 
-    sheet_[pos]->Clear();
-    min_print_area_.SubCountPositions(pos);
+    if(!cell->GetReferencedRanges().empty() || HasRangeDependents(pos)) {
+        std::vector<Cell::Content> contents;
+        contents.push_back(Cell::Parse(""s, pos, *this));
+        ApplyContents({pos}, std::move(contents));
+    } else if(!cell->IsEmpty()) {
+        const SumIndex::Totals before = GetSumTotals(cell);
+        cell->Clear();
+        min_print_area_.SubCountPositions(pos);
+        UpdateSumIndex(pos, before, cell);
+    }
+
+    // На ячейку, от которой никто не зависит, больше нечему ссылаться
+    if(!cell->IsReferenced()) {
+        cells_.Erase(pos);
+    }
 }
 
 Size Sheet::GetPrintableSize() const {
@@ -72,52 +324,394 @@ Size Sheet::GetPrintableSize() const {
 }
 
 void Sheet::PrintValues(std::ostream& output) const {
-    const Size size = GetPrintableSize();
+    BufferedWriter writer(output);
+    PrintValues(writer);
+}
+
+void Sheet::PrintValues(int fd) const {
+    BufferedWriter writer(fd);
+    PrintValues(writer);
+}
+
+void Sheet::PrintTexts(std::ostream& output) const {
+    MaterializeAll();
+
+    BufferedWriter writer(output);
+    PrintCells(writer, cells_.SortedTileKeys(), 0, GetPrintableSize().rows, [&writer](const Cell& cell) {
+        writer.Write(cell.GetTextView());
+    });
+    writer.Flush();
+}
 
-    for(int row = 0; row < size.rows; ++row) {
-        bool it_first = true;
+void Sheet::PrintValues(BufferedWriter& writer) const {
+    MaterializeAll();
+    PrintValueRows(writer, cells_.SortedTileKeys(), 0, GetPrintableSize().rows);
+    writer.Flush();
+}
+
+void Sheet::PrintValues(std::ostream& output, Range range) const {
+    ThrowIfNotValid(range);
+    MaterializeRange(range);
 
-        for(int col = 0; col < size.cols; ++col) {
-            if(!it_first){
-                output << "\t";
+    BufferedWriter writer(output);
+    for(int row = range.first.row; row <= range.last.row; ++row) {
+        int col = range.first.col;
+        cells_.ForEachInRow(row, range.first.col, range.last.col + 1, [&](int cell_col, const Cell& cell) {
+            for(; col < cell_col; ++col) {
+                writer.Write('\t');
             }
-            
-            Position pos{row, col};
+            WriteValue(writer, cell.GetValueView());
+        });
+
+        for(; col < range.last.col; ++col) {
+            writer.Write('\t');
+        }
+        writer.Write('\n');
+    }
+    writer.Flush();
+}
+
+void Sheet::GetValues(Range range, std::vector<CellInterface::Value>& values) const {
+    ThrowIfNotValid(range);
+    MaterializeRange(range);
+
+    const Size size = range.GetSize();
+    values.assign(static_cast<size_t>(size.rows) * size.cols, ""s);
+    for(int row = range.first.row; row <= range.last.row; ++row) {
+        const size_t row_offset = static_cast<size_t>(row - range.first.row) * size.cols;
+        cells_.ForEachInRow(row, range.first.col, range.last.col + 1, [&](int col, const Cell& cell) {
+            values[row_offset + col - range.first.col] = cell.GetValue();
+        });
+    }
+}
 
-            if(CheckCurrentPosition(pos)) {
-                auto temp_value = sheet_.at(pos)->GetValue();
-                std::visit([&output](auto&& arg) {output << arg; }, temp_value);
+void Sheet::ExportValues(std::ostream& output, size_t thread_count) {
+    // После вычисления всех формул GetValue только читает кеши, и блоки
+    // строк можно выводить параллельно
+    Recalculate(thread_count);
+
+    const int rows = GetPrintableSize().rows;
+    thread_count = std::max<size_t>(thread_count, 1);
+
+    // Блоки выровнены по полосам тайлов, чтобы тайл обходился одним блоком
+    const int block_rows = std::max(CellStorage::TILE_SIZE,
+        (rows / static_cast<int>(thread_count * EXPORT_BLOCKS_PER_THREAD)) & ~(CellStorage::TILE_SIZE - 1));
+    const int block_count = (rows + block_rows - 1) / block_rows;
+    // Ключи сортируются один раз, блок находит в них свою полосу поиском
+    const std::vector<PositionKey> tile_keys = cells_.SortedTileKeys();
+
+    std::vector<std::string> blocks(block_count);
+    std::atomic<int> next_block = 0;
+    const auto render = [&]() {
+        for(int block = next_block++; block < block_count; block = next_block++) {
+            BufferedWriter writer(blocks[block]);
+            PrintValueRows(writer, tile_keys, block * block_rows, std::min(rows, (block + 1) * block_rows));
+            writer.Flush();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < std::min<size_t>(thread_count, block_count); ++i) {
+        threads.emplace_back(render);
+    }
+    render();
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    for(const auto& block : blocks) {
+        output.write(block.data(), block.size());
+    }
+}
+
+void Sheet::PrintValueRows(BufferedWriter& writer, const std::vector<PositionKey>& tile_keys,
+                           int row_begin, int row_end) const {
+    PrintCells(writer, tile_keys, row_begin, row_end, [&writer](const Cell& cell) {
+        WriteValue(writer, cell.GetValueView());
+    });
+}
+
+void Sheet::Recalculate(size_t thread_count) {
+    // Потоки не должны переносить тайлы, поэтому всё переносится заранее
+    MaterializeAll();
+
+    std::vector<Cell*> dirty_cells;
+    cells_.ForEach([&dirty_cells](Position, Cell& cell) {
+        if(cell.IsDirty()) {
+            dirty_cells.push_back(&cell);
+        }
+    });
+
+    for(const auto& level : Cell::SplitIntoLevels(std::move(dirty_cells))) {
+        EvaluateLevel(level, thread_count);
+    }
+}
+
+void Sheet::EvaluateLevel(const std::vector<Cell*>& level, size_t thread_count) const {
+    // Формулы одного дерева собираются по столбцам сверху вниз
+    std::vector<std::pair<ColumnKey, Cell*>> keyed;
+    keyed.reserve(level.size());
+    for(Cell* cell : level) {
+        keyed.emplace_back(GetColumnKey(*cell->GetFormula()), cell);
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const auto& lhs, const auto& rhs) {
+        return std::tuple(lhs.first.tree, lhs.first.origin.col, lhs.first.origin.row)
+             < std::tuple(rhs.first.tree, rhs.first.origin.col, rhs.first.origin.row);
+    });
+
+    std::vector<Cell*> cells;
+    cells.reserve(keyed.size());
+    for(const auto& [key, cell] : keyed) {
+        cells.push_back(cell);
+    }
+
+    // Задание - часть столбца или пачка отдельных формул
+    struct Task {
+        size_t begin;
+        size_t end;
+        bool is_column;
+    };
+    std::vector<Task> tasks;
+    const auto add_singles = [&tasks](size_t begin, size_t end) {
+        if(!tasks.empty() && !tasks.back().is_column && tasks.back().end == begin
+           && end - tasks.back().begin <= COLUMN_TASK_SIZE) {
+            tasks.back().end = end;
+        } else if(begin < end) {
+            tasks.push_back({begin, end, false});
+        }
+    };
+
+    for(size_t begin = 0, end = 0; begin < keyed.size(); begin = end) {
+        const ColumnKey& first = keyed[begin].first;
+        for(end = begin + 1; end < keyed.size() && first.tree; ++end) {
+            const ColumnKey& key = keyed[end].first;
+            if(key.tree != first.tree || key.origin.col != first.origin.col
+               || key.origin.row != first.origin.row + static_cast<int>(end - begin)) {
+                break;
             }
-            it_first = false;
         }
-        output << "\n";
+
+        if(end - begin < MIN_COLUMN_RUN) {
+            add_singles(begin, end);
+            continue;
+        }
+        for(size_t part = begin; part < end; part += COLUMN_TASK_SIZE) {
+            tasks.push_back({part, std::min(part + COLUMN_TASK_SIZE, end), true});
+        }
+    }
+
+    // Ссылки ячеек уровня уже вычислены, поэтому каждый поток только читает
+    // чужие кеши и заполняет кеши своих ячеек
+    std::atomic<size_t> next_task = 0;
+    const auto evaluate = [&]() {
+        for(size_t i = next_task++; i < tasks.size(); i = next_task++) {
+            const Task& task = tasks[i];
+            if(task.is_column) {
+                Cell::EvaluateColumn(cells.begin() + task.begin, cells.begin() + task.end);
+                continue;
+            }
+            for(size_t j = task.begin; j < task.end; ++j) {
+                cells[j]->GetNumericValue();
+            }
+        }
+    };
+
+    if(thread_count <= 1 || level.size() < MIN_PARALLEL_LEVEL_SIZE) {
+        evaluate();
+        return;
+    }
+
+    thread_count = std::min(thread_count, tasks.size());
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for(size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(evaluate);
+    }
+    evaluate();
+
+    for(auto& thread : threads) {
+        thread.join();
     }
 }
-void Sheet::PrintTexts(std::ostream& output) const {
-    const Size size = GetPrintableSize();
 
-    for(int row = 0; row < size.rows; ++row) {
-        bool it_first = true;
+FormulaPool& Sheet::GetFormulaPool() {
+    return formula_pool_;
+}
+
+std::uint64_t Sheet::NextVisitEpoch() {
+    return ++visit_epoch_;
+}
+
+std::int64_t Sheet::TakeOrderAfterAll() {
+    return ++max_order_;
+}
+
+std::int64_t Sheet::TakeOrderBeforeAll() {
+    return --min_order_;
+}
+
+void Sheet::LoadTexts(std::istream& input) {
+    std::vector<char> buffer(LOAD_BUFFER_SIZE);
+    // Позиции возрастают, поэтому пакет не требует сортировки, как в
+    // ApplyBatch, и поле разбирается сразу, пока оно лежит в буфере
+    std::vector<Position> positions;
+    std::vector<Cell::Content> contents;
+    // Начало поля, оборвавшегося на границе блока
+    std::string field_head;
+    Position pos{0, 0};
+
+    const auto add_field = [&](std::string_view field) {
+        if(field_head.empty() && field.empty()) {
+            return;
+        }
+        ThrowIfNotValid(pos);
+        if(field_head.empty()) {
+            contents.push_back(Cell::Parse(field, pos, *this));
+        } else {
+            field_head.append(field);
+            contents.push_back(Cell::Parse(std::move(field_head), pos, *this));
+            field_head.clear();
+        }
+        positions.push_back(pos);
+    };
+
+    while(input) {
+        input.read(buffer.data(), buffer.size());
+        const char* const end = buffer.data() + input.gcount();
 
-        for(int col = 0; col < size.cols; ++col) {
-            if(!it_first){
-                output << "\t";
+        const char* field_begin = buffer.data();
+        for(const char* it = field_begin; it != end; ++it) {
+            if(*it != '\t' && *it != '\n') {
+                continue;
             }
-            
-            Position pos{row, col};
 
-            if(CheckCurrentPosition(pos)) {
-                output << sheet_.at(pos)->GetText();
+            add_field(std::string_view(field_begin, it - field_begin));
+            if(*it == '\t') {
+                ++pos.col;
+            } else {
+                ++pos.row;
+                pos.col = 0;
             }
-            it_first = false;
+            field_begin = it + 1;
+        }
+        field_head.append(field_begin, end);
+
+        if(positions.size() >= LOAD_BATCH_SIZE) {
+            ApplyContents(positions, std::move(contents));
+            positions.clear();
+            contents.clear();
         }
-        output << "\n";
+    }
+
+    add_field({});
+    ApplyContents(positions, std::move(contents));
+}
+
+template <typename Printer>
+void Sheet::PrintCells(BufferedWriter& output, const std::vector<PositionKey>& tile_keys,
+                       int row_begin, int row_end, Printer print_cell) const {
+    const Size size = GetPrintableSize();
+    row_end = std::min(row_end, size.rows);
+    if(row_begin >= row_end) {
+        return;
+    }
+
+    // Пропуски между ячейками выводятся целыми кусками этой строки,
+    // пустая строка листа - ею же целиком
+    std::string empty_row(size.cols - 1, '\t');
+    empty_row.push_back('\n');
+
+    int row = row_begin;
+    int tabs = 0;
+    const auto finish_rows = [&](int end_row) {
+        if(row >= end_row) {
+            return;
+        }
+        output.Write(std::string_view(empty_row).substr(tabs));
+        for(++row; row < end_row; ++row) {
+            output.Write(empty_row);
+        }
+        tabs = 0;
+    };
+
+    // Ячейки вне печатной области пусты и ничего не выводят
+    cells_.ForEachOrdered(tile_keys, row_begin, row_end, [&](Position pos, const Cell& cell) {
+        if(pos.col >= size.cols) {
+            return;
+        }
+        finish_rows(pos.row);
+        output.Write(std::string_view(empty_row.data(), pos.col - tabs));
+        tabs = pos.col;
+        print_cell(cell);
+    });
+
+    finish_rows(row_end);
+}
+
+void Sheet::GetColumnCells(Position first, size_t count, const Cell** cells) const {
+    if(mapped_snapshot_) {
+        for(size_t i = 0; i < count; ++i) {
+            cells[i] = FindCell({first.row + static_cast<int>(i), first.col});
+        }
+        return;
+    }
+    cells_.FindInColumn(first, count, cells);
+}
+
+Cell* Sheet::FindCell(Position pos) const {
+    // Существующая ячейка всегда лежит в перенесённом тайле: ссылка на
+    // ячейку из снимка сначала переносит её тайл
+    Cell* cell = cells_.Find(pos);
+    if(!cell && mapped_snapshot_) {
+        MaterializeRange({pos, pos});
+        cell = cells_.Find(pos);
+    }
+    return cell;
+}
+
+// Перенос тайлов не меняет видимого содержимого листа, поэтому доступен и
+// константным методам
+void Sheet::MaterializeAll() const {
+    if(!mapped_snapshot_) {
+        return;
+    }
+
+    std::vector<size_t> tiles;
+    for(size_t i = 0; i < mapped_snapshot_->GetTileCount(); ++i) {
+        if(!mapped_snapshot_->IsLoaded(i)) {
+            tiles.push_back(i);
+        }
+    }
+    const_cast<Sheet*>(this)->MaterializeTiles(tiles);
+}
+
+void Sheet::MaterializeRange(Range range) const {
+    if(!mapped_snapshot_) {
+        return;
+    }
+
+    std::vector<size_t> tiles;
+    for(int tile_row = range.first.row >> CellStorage::TILE_SHIFT;
+        tile_row <= range.last.row >> CellStorage::TILE_SHIFT; ++tile_row) {
+        for(int tile_col = range.first.col >> CellStorage::TILE_SHIFT;
+            tile_col <= range.last.col >> CellStorage::TILE_SHIFT; ++tile_col) {
+            const auto tile = mapped_snapshot_->FindTile(CellStorage::TileKey(tile_row, tile_col));
+            if(tile && !mapped_snapshot_->IsLoaded(*tile)) {
+                tiles.push_back(*tile);
+            }
+        }
+    }
+    if(!tiles.empty()) {
+        const_cast<Sheet*>(this)->MaterializeTiles(tiles);
     }
 }
 
-bool Sheet::CheckCurrentPosition(Position pos) const {
-    const auto& cell = sheet_.find(pos);
-    return cell != sheet_.end() && cell->second != nullptr && cell->second->GetText() != ""s;
+void Sheet::UpdatePrintArea(Position pos, bool was_printable, bool is_printable) {
+    if(!was_printable && is_printable) {
+        min_print_area_.AddCountPositions(pos);
+    } else if(was_printable && !is_printable) {
+        min_print_area_.SubCountPositions(pos);
+    }
 }
 
 void Sheet::ThrowIfNotValid(Position pos) const {
@@ -126,6 +720,12 @@ void Sheet::ThrowIfNotValid(Position pos) const {
     }
 }
 
+void Sheet::ThrowIfNotValid(Range range) const {
+    if(!range.IsValid()) {
+        throw InvalidPositionException("Invalid range");
+    }
+}
+
 void Sheet::MinPrintArea::AddCountPositions(Position pos) {
     ++rows_with_data_per_index[pos.row];
     ++cols_with_data_per_index[pos.col];
@@ -151,6 +751,18 @@ Size Sheet::MinPrintArea::GetMinPrintArea() const {
                 cols_with_data_per_index.rbegin()->first + 1};
 }
 
+void Sheet::MinPrintArea::SetCount(bool is_row, int index, int count) {
+    (is_row ? rows_with_data_per_index : cols_with_data_per_index)[index] = count;
+}
+
+const std::map<int, int>& Sheet::MinPrintArea::GetRowCounts() const {
+    return rows_with_data_per_index;
+}
+
+const std::map<int, int>& Sheet::MinPrintArea::GetColCounts() const {
+    return cols_with_data_per_index;
+}
+
 void Sheet::MinPrintArea::DeleteNullRowPosition(int index) {
     rows_with_data_per_index.erase(index);
 }
@@ -1,32 +1,48 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <map>
-#include <unordered_map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "cell.h"
+#include "cell_storage.h"
 #include "common.h"
+#include "formula.h"
+#include "range_index.h"
+#include "sum_index.h"
 
-class CellHasher {
-public:
-    size_t operator()(const Position p) const {
-        return std::hash<std::string>()(p.ToString());
-    }
-};
+class BufferedWriter;
+class MappedSnapshot;
 
 class Sheet : public SheetInterface {
 public:
-    using Sheet_ = std::unordered_map<Position, std::unique_ptr<Cell>, CellHasher>;
-
+    Sheet();
     ~Sheet();
 
     void SetCell(Position pos, std::string text) override;
 
+    // Задаёт содержимое нескольких ячеек как одну транзакцию: все формулы
+    // разбираются до изменения листа, циклы проверяются один раз для всего
+    // пакета, кеши зависимых ячеек сбрасываются одним проходом. При повторе
+    // позиции действует последнее значение. Если хотя бы одна позиция,
+    // формула или ссылка некорректна, бросается то же исключение, что и в
+    // SetCell, а лист остаётся прежним.
+    void ApplyBatch(std::vector<std::pair<Position, std::string>> batch);
+
     const CellInterface* GetCell(Position pos) const override;
     CellInterface* GetCell(Position pos) override;
 
     const Cell* GetConcreteCell(Position pos) const;
     Cell* GetConcreteCell(Position pos);
+    // Записывает в cells[i] ячейку на i строк ниже first или nullptr, если
+    // её нет. Позиции должны быть корректны.
+    void GetColumnCells(Position first, size_t count, const Cell** cells) const;
 
     void ClearCell(Position pos) override;
 
@@ -34,6 +50,79 @@ public:
 
     void PrintValues(std::ostream& output) const override;
     void PrintTexts(std::ostream& output) const override;
+    // Выводит значения в файловый дескриптор в том же формате, минуя потоки
+    void PrintValues(int fd) const;
+    // Выводят значения ячеек области range: по строке вывода на каждую
+    // строку области, столбцы разделены табуляцией, пустые ячейки пусты.
+    // Вычисляются только формулы области и те, от которых они зависят.
+    // Бросают InvalidPositionException, если область некорректна.
+    void PrintValues(std::ostream& output, Range range) const;
+    // Записывает значения области построчно в values, заменяя её содержимое;
+    // пустой ячейке соответствует пустая строка
+    void GetValues(Range range, std::vector<CellInterface::Value>& values) const;
+    // Выводит то же, что PrintValues, но сначала вычисляет все формулы, а
+    // затем формирует блоки строк параллельно в thread_count потоках и
+    // записывает их по порядку
+    void ExportValues(std::ostream& output, size_t thread_count = std::thread::hardware_concurrency());
+
+    // Загружает таблицу в формате PrintTexts: столбцы разделены табуляцией,
+    // строки - переводом строки, первая строка и первый столбец соответствуют
+    // A1. Поток читается блоками фиксированного размера, поля разбираются
+    // прямо из блока и применяются пакетами, поэтому память не зависит от
+    // объёма данных.
+    // Пустые поля пропускаются. Если пакет содержит некорректную формулу или
+    // цикл, бросается исключение; пакеты, загруженные до него, остаются.
+    void LoadTexts(std::istream& input);
+
+    // Записывает лист в бинарный снимок, формат описан в snapshot_format.h.
+    // Позиции хранятся упакованными ключами, тексты - в общей таблице строк,
+    // формулы - в уже разобранном виде.
+    void SaveSnapshot(std::ostream& output) const;
+    // Заменяет содержимое листа снимком, записанным SaveSnapshot. Поток
+    // читается целиком за один проход, тексты формул не разбираются.
+    // Если снимок повреждён или несовместим, бросается SnapshotException и
+    // лист не меняется. Если снимок содержит цикл, бросается
+    // CircularDependencyException и лист остаётся пустым.
+    void LoadSnapshot(std::istream& input);
+    // Заменяет содержимое листа снимком из файла path, не читая ячеек:
+    // файл отображается в память, а тайл переносится в лист при первом
+    // обращении к его ячейкам вместе со всеми тайлами, от которых зависят его
+    // формулы. Размер печатной области известен сразу. Операции над всем
+    // листом (печать, Recalculate, SaveSnapshot) переносят все тайлы.
+    // Повреждённый тайл обнаруживается при обращении к нему, тогда
+    // бросается SnapshotException.
+    void MapSnapshot(const std::string& path);
+
+    // Вычисляет все формулы, значения которых устарели. Независимые формулы
+    // вычисляются параллельно в thread_count потоках, результат совпадает с
+    // последовательным вычислением.
+    void Recalculate(size_t thread_count = std::thread::hardware_concurrency());
+
+    // Включает индекс сумм над областью region: SUM, AVERAGE и COUNT от
+    // областей внутри неё, в которых нет формул, берут сумму и количество
+    // чисел из индекса за логарифмическое время вместо перебора ячеек.
+    // Индекс отвечает, только если его сумма точна: все числа области целые,
+    // не больше 2^32 по модулю, и сумма их модулей не больше 2^53. Тогда она
+    // совпадает с перебором бит в бит, иначе область перебирается.
+    // Занимает 32 байта на позицию области, nullopt выключает индекс.
+    // Бросает InvalidPositionException, если область некорректна.
+    void SetSumIndexRegion(std::optional<Range> region);
+    // Записывает в sum и count сумму и количество чисел области по индексу
+    // сумм. Возвращает false, если индекса нет, область выходит за него,
+    // содержит формулы или сумма индекса может отличаться от перебора: тогда
+    // область перебирается.
+    bool TrySumRange(Range range, double& sum, double& count) const;
+
+    // Общие разобранные формулы ячеек листа
+    FormulaPool& GetFormulaPool();
+
+    // Возвращает новый номер обхода графа зависимостей. Ячейки помечают себя
+    // этим номером вместо заведения множества посещённых.
+    std::uint64_t NextVisitEpoch();
+
+    // Выдают топологические номера, большие или меньшие всех выданных ранее
+    std::int64_t TakeOrderAfterAll();
+    std::int64_t TakeOrderBeforeAll();
 private:
     class MinPrintArea {
     public:
@@ -41,6 +130,12 @@ private:
         void SubCountPositions(Position pos);
 
         Size GetMinPrintArea() const;
+        // Задаёт число непустых ячеек в строке (is_row) или столбце index
+        void SetCount(bool is_row, int index, int count);
+
+        // Число непустых ячеек в каждой непустой строке и столбце
+        const std::map<int, int>& GetRowCounts() const;
+        const std::map<int, int>& GetColCounts() const;
     private:
         std::map<int, int> cols_with_data_per_index;
         std::map<int, int> rows_with_data_per_index;
@@ -49,10 +144,61 @@ private:
         void DeleteNullColPosition(int index);
     };
 
-    Sheet_ sheet_;
+    CellStorage cells_;
     MinPrintArea min_print_area_;
+    // Области, переданные функциям формул. Формула зависит от области как
+    // целого: рёбра графа ведут только к формулам внутри неё, а об изменении
+    // остальных ячеек области формулу оповещает лист по этому индексу.
+    RangeIndex range_dependents_;
+    FormulaPool formula_pool_;
+    std::unique_ptr<SumIndex> sum_index_;
+    // Снимок, тайлы которого ещё не все перенесены в cells_
+    std::unique_ptr<MappedSnapshot> mapped_snapshot_;
+    std::uint64_t visit_epoch_ = 0;
+    std::int64_t max_order_ = 0;
+    std::int64_t min_order_ = 0;
         
-    //Возвращает true, когда позиция задана, не является nullptr и не пустая ячейка
-    bool CheckCurrentPosition(Position pos) const;
+    // Уровни меньше этого размера не стоят запуска потоков
+    static const size_t MIN_PARALLEL_LEVEL_SIZE = 256;
+    // Формулы одного дерева в идущих подряд ячейках столбца вычисляются
+    // столбцом, если их хотя бы столько. Длинные столбцы режутся на части
+    // не больше COLUMN_TASK_SIZE, которые вычисляются параллельно.
+    static const size_t MIN_COLUMN_RUN = 8;
+    static const size_t COLUMN_TASK_SIZE = 256;
+    static const size_t LOAD_BUFFER_SIZE = 1 << 16;
+    static const size_t LOAD_BATCH_SIZE = 1 << 16;
+    // Число блоков строк на поток при экспорте, чтобы потоки догоняли друг
+    // друга на неравномерно заполненных строках
+    static const size_t EXPORT_BLOCKS_PER_THREAD = 4;
+
+    void PrintValues(BufferedWriter& writer) const;
+    // tile_keys - результат cells_.SortedTileKeys() после MaterializeAll
+    void PrintValueRows(BufferedWriter& writer, const std::vector<PositionKey>& tile_keys,
+                        int row_begin, int row_end) const;
+    template <typename Printer>
+    void PrintCells(BufferedWriter& output, const std::vector<PositionKey>& tile_keys,
+                    int row_begin, int row_end, Printer print_cell) const;
+    void ApplyContents(const std::vector<Position>& positions, std::vector<Cell::Content> contents,
+                       bool update_print_area = true);
+    // Добавляет к ссылкам ячеек пакета формулы внутри их областей. Формулы
+    // вне пакета, области которых содержат его позиции, попадают в
+    // range_dependents, а если ячейка их области становится формулой или
+    // перестаёт ею быть - в пакет с пустым содержимым и новыми ссылками.
+    void AddRangeReferences(const std::vector<Position>& positions, std::vector<Cell*>& cells,
+                            std::vector<Cell::Content>& contents,
+                            std::vector<std::vector<Cell*>>& references,
+                            std::vector<Cell*>& range_dependents) const;
+    bool HasRangeDependents(Position pos) const;
+    // Переносит в индекс сумм изменение ячейки pos, итоги которой до
+    // изменения были before
+    void UpdateSumIndex(Position pos, const SumIndex::Totals& before, const Cell* cell);
+    // Находит ячейку, сначала перенося её тайл из снимка, если он ещё не перенесён
+    Cell* FindCell(Position pos) const;
+    void MaterializeAll() const;
+    void MaterializeRange(Range range) const;
+    void MaterializeTiles(const std::vector<size_t>& tiles);
+    void EvaluateLevel(const std::vector<Cell*>& level, size_t thread_count) const;
     void ThrowIfNotValid(Position pos) const;
-};
\ No newline at end of file
+    void ThrowIfNotValid(Range range) const;
+    void UpdatePrintArea(Position pos, bool was_printable, bool is_printable);
+};
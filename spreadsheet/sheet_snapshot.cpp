@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+#include "cell.h"
+#include "common.h"
+#include "flat_hash_map.h"
+#include "mapped_snapshot.h"
+#include "sheet.h"
+#include "snapshot_format.h"
+
+namespace {
+
+struct SnapshotCell {
+    PositionKey tile_key;
+    std::uint16_t local_offset;
+    std::string_view text;
+    const FormulaInterface* formula;
+};
+
+// Тексты пишутся в таблицу строк один раз, повторные ссылаются на первое вхождение
+class StringTable {
+public:
+    std::pair<std::uint64_t, std::uint32_t> Add(std::string_view text) {
+        const auto [it, inserted] = offsets_.emplace(text, data_.size());
+        if (inserted) {
+            data_.append(text);
+        }
+        return {it->second, static_cast<std::uint32_t>(text.size())};
+    }
+
+    const std::string& GetData() const {
+        return data_;
+    }
+
+private:
+    std::unordered_map<std::string_view, std::uint64_t> offsets_;
+    std::string data_;
+};
+
+// Разбирает записи ячеек блока тайла tile, добавляя их позиции и содержимое
+void DecodeTile(std::string_view block, const snapshot::TileEntry& tile, std::string_view strings,
+                Sheet& sheet, std::vector<Position>& positions, std::vector<Cell::Content>& contents) {
+    const Position tile_pos = UnpackPosition(tile.key);
+    snapshot::Reader cells(block);
+    int prev_offset = -1;
+    std::uint32_t cell_count = 0;
+
+    for (; !cells.AtEnd(); ++cell_count) {
+        const int local_offset = cells.GetU16();
+        const auto kind = static_cast<snapshot::CellKind>(cells.GetU8());
+        const std::uint64_t text_offset = cells.GetU64();
+        const std::string_view text = snapshot::Slice(strings, text_offset, cells.GetU32());
+
+        const Position pos{(tile_pos.row << CellStorage::TILE_SHIFT) + (local_offset >> CellStorage::TILE_SHIFT),
+                           (tile_pos.col << CellStorage::TILE_SHIFT) + (local_offset & (CellStorage::TILE_SIZE - 1))};
+        if (local_offset <= prev_offset || local_offset >= CellStorage::TILE_AREA || !pos.IsValid()) {
+            throw SnapshotException("Invalid cell position in snapshot");
+        }
+        prev_offset = local_offset;
+
+        const bool is_formula_text = text.size() > 1 && text[0] == FORMULA_SIGN;
+        if (kind == snapshot::CellKind::Formula && is_formula_text) {
+            auto formula = sheet.GetFormulaPool().Deserialize(cells.GetBytes(cells.GetU32()), pos);
+            contents.push_back(Cell::FromFormula(std::string(text), std::move(formula), sheet));
+        } else if (kind == snapshot::CellKind::Text && !is_formula_text && !text.empty()) {
+            contents.push_back(Cell::Parse(text, pos, sheet));
+        } else {
+            throw SnapshotException("Invalid cell record in snapshot");
+        }
+        positions.push_back(pos);
+    }
+
+    if (cell_count != tile.cell_count) {
+        throw SnapshotException("Snapshot tile cell count mismatch");
+    }
+}
+
+std::string ReadAll(std::istream& input, size_t chunk_size) {
+    std::string data;
+    size_t size = 0;
+    while (input) {
+        data.resize(size + chunk_size);
+        input.read(data.data() + size, chunk_size);
+        size += input.gcount();
+    }
+    data.resize(size);
+    return data;
+}
+
+}  // namespace
+
+void Sheet::SaveSnapshot(std::ostream& output) const {
+    MaterializeAll();
+
+    std::vector<SnapshotCell> snapshot_cells;
+    snapshot_cells.reserve(cells_.Size());
+    cells_.ForEach([&snapshot_cells](Position pos, const Cell& cell) {
+        // Пустые ячейки существуют только как цели ссылок и восстанавливаются сами
+        if (cell.IsEmpty()) {
+            return;
+        }
+        snapshot_cells.push_back({CellStorage::TileKey(pos.row >> CellStorage::TILE_SHIFT,
+                                                       pos.col >> CellStorage::TILE_SHIFT),
+                                  static_cast<std::uint16_t>(CellStorage::LocalOffset(pos)),
+                                  cell.GetTextView(), cell.GetFormula()});
+    });
+    std::sort(snapshot_cells.begin(), snapshot_cells.end(), [](const auto& lhs, const auto& rhs) {
+        return std::pair(lhs.tile_key, lhs.local_offset) < std::pair(rhs.tile_key, rhs.local_offset);
+    });
+
+    StringTable strings;
+    std::vector<snapshot::TileEntry> tiles;
+    std::string blocks;
+    snapshot::Writer block_writer(blocks);
+    std::string formula;
+    // Сумма тайла продолжается текстами его ячеек, см. snapshot::ReadTileBlock
+    std::vector<std::string_view> texts;
+
+    for (size_t begin = 0, end = 0; begin < snapshot_cells.size(); begin = end) {
+        snapshot::TileEntry tile;
+        tile.key = snapshot_cells[begin].tile_key;
+        tile.offset = blocks.size();
+
+        texts.clear();
+        for (end = begin; end < snapshot_cells.size() && snapshot_cells[end].tile_key == tile.key; ++end) {
+            const SnapshotCell& cell = snapshot_cells[end];
+            const auto [text_offset, text_size] = strings.Add(cell.text);
+
+            block_writer.PutU16(cell.local_offset);
+            block_writer.PutU8(static_cast<std::uint8_t>(cell.formula ? snapshot::CellKind::Formula
+                                                                      : snapshot::CellKind::Text));
+            block_writer.PutU64(text_offset);
+            block_writer.PutU32(text_size);
+            texts.push_back(cell.text);
+            if (cell.formula) {
+                formula.clear();
+                cell.formula->Serialize(formula);
+                block_writer.PutU32(static_cast<std::uint32_t>(formula.size()));
+                block_writer.PutBytes(formula);
+            }
+        }
+
+        tile.cell_count = static_cast<std::uint32_t>(end - begin);
+        tile.size = blocks.size() - tile.offset;
+        tile.checksum = snapshot::Checksum(std::string_view(blocks).substr(tile.offset, tile.size));
+        for (const std::string_view text : texts) {
+            tile.checksum = snapshot::Checksum(text, tile.checksum);
+        }
+        tiles.push_back(tile);
+    }
+
+    const auto& row_counts = min_print_area_.GetRowCounts();
+    const auto& col_counts = min_print_area_.GetColCounts();
+    const size_t print_area_size = row_counts.size() + col_counts.size();
+    const std::uint64_t blocks_offset = snapshot::HEADER_SIZE + tiles.size() * snapshot::TILE_ENTRY_SIZE
+                                        + print_area_size * snapshot::PRINT_AREA_ENTRY_SIZE;
+
+    std::string body;
+    snapshot::Writer body_writer(body);
+    for (const snapshot::TileEntry& tile : tiles) {
+        body_writer.PutU32(tile.key);
+        body_writer.PutU32(tile.cell_count);
+        body_writer.PutU64(blocks_offset + tile.offset);
+        body_writer.PutU64(tile.size);
+        body_writer.PutU64(tile.checksum);
+    }
+    for (const auto& [axis, counts] : {std::pair{0, &row_counts}, std::pair{1, &col_counts}}) {
+        for (const auto& [index, count] : *counts) {
+            body_writer.PutU8(static_cast<std::uint8_t>(axis));
+            body_writer.PutU32(static_cast<std::uint32_t>(index));
+            body_writer.PutU32(static_cast<std::uint32_t>(count));
+        }
+    }
+
+    std::string header;
+    snapshot::Writer header_writer(header);
+    header_writer.PutBytes(std::string_view(snapshot::MAGIC, sizeof(snapshot::MAGIC)));
+    header_writer.PutU32(snapshot::VERSION);
+    header_writer.PutU32(static_cast<std::uint32_t>(tiles.size()));
+    header_writer.PutU32(static_cast<std::uint32_t>(print_area_size));
+    header_writer.PutU64(blocks_offset + blocks.size());
+    header_writer.PutU64(strings.GetData().size());
+    header_writer.PutU64(snapshot::Checksum(strings.GetData()));
+    header_writer.PutU64(snapshot::Checksum(body));
+    header_writer.PutU64(snapshot::Checksum(header));
+
+    output.write(header.data(), header.size());
+    output.write(body.data(), body.size());
+    output.write(blocks.data(), blocks.size());
+    output.write(strings.GetData().data(), strings.GetData().size());
+}
+
+void Sheet::LoadSnapshot(std::istream& input) {
+    const std::string data = ReadAll(input, LOAD_BUFFER_SIZE);
+
+    const snapshot::Header header = snapshot::ReadHeader(data);
+    snapshot::Reader directory(snapshot::ReadBody(data, header));
+    const std::string_view strings = snapshot::Slice(data, header.strings_offset, header.strings_size);
+    if (snapshot::Checksum(strings) != header.strings_checksum) {
+        throw SnapshotException("Snapshot string table checksum mismatch");
+    }
+
+    std::vector<Position> positions;
+    std::vector<Cell::Content> contents;
+    std::int64_t prev_key = -1;
+
+    for (std::uint32_t i = 0; i < header.tile_count; ++i) {
+        const snapshot::TileEntry tile = snapshot::ReadTileEntry(directory);
+        if (static_cast<std::int64_t>(tile.key) <= prev_key) {
+            throw SnapshotException("Snapshot tiles are not sorted");
+        }
+        prev_key = tile.key;
+
+        DecodeTile(snapshot::ReadTileBlock(data, tile, strings), tile, strings, *this, positions, contents);
+    }
+
+    // Снимок полностью прочитан и проверен, теперь лист можно заменить
+    mapped_snapshot_.reset();
+    cells_.Clear();
+    min_print_area_ = MinPrintArea();
+    range_dependents_.Clear();
+    if (sum_index_) {
+        sum_index_ = std::make_unique<SumIndex>(sum_index_->GetRegion());
+    }
+    ApplyContents(positions, std::move(contents));
+}
+
+void Sheet::MapSnapshot(const std::string& path) {
+    auto mapped_snapshot = std::make_unique<MappedSnapshot>(path);
+
+    MinPrintArea print_area;
+    snapshot::Reader in(mapped_snapshot->GetPrintArea());
+    while (!in.AtEnd()) {
+        const std::uint8_t axis = in.GetU8();
+        const std::uint32_t index = in.GetU32();
+        const std::uint32_t count = in.GetU32();
+        if (axis > 1 || count == 0 || index >= static_cast<std::uint32_t>(axis == 0 ? Position::MAX_ROWS : Position::MAX_COLS)) {
+            throw SnapshotException("Invalid print area in snapshot");
+        }
+        print_area.SetCount(axis == 0, static_cast<int>(index), static_cast<int>(count));
+    }
+
+    cells_.Clear();
+    min_print_area_ = std::move(print_area);
+    range_dependents_.Clear();
+    if (sum_index_) {
+        sum_index_ = std::make_unique<SumIndex>(sum_index_->GetRegion());
+    }
+    mapped_snapshot_ = std::move(mapped_snapshot);
+    if (mapped_snapshot_->AllLoaded()) {
+        mapped_snapshot_.reset();
+    }
+}
+
+void Sheet::MaterializeTiles(const std::vector<size_t>& tiles) {
+    std::vector<Position> positions;
+    std::vector<Cell::Content> contents;
+    // Тайлы отмечаются загруженными при постановке в очередь, чтобы не
+    // разбирать их повторно; при ошибке отметки снимаются
+    std::vector<size_t> marked;
+
+    std::vector<size_t> worklist;
+
+    const auto enqueue = [this, &worklist, &marked](size_t index) {
+        if (!mapped_snapshot_->IsLoaded(index)) {
+            mapped_snapshot_->SetLoaded(index, true);
+            marked.push_back(index);
+            worklist.push_back(index);
+        }
+    };
+
+    for (size_t index : tiles) {
+        enqueue(index);
+    }
+
+    try {
+        // Вместе с тайлом переносятся все тайлы, на которые ссылаются его
+        // формулы, поэтому у каждой перенесённой ячейки все ячейки выше по
+        // графу зависимостей уже в листе: вычисление и поиск циклов не видят
+        // недостающих рёбер. Зависимые ячейки из не перенесённых тайлов ещё не
+        // вычислялись, и сбрасывать их кеши не нужно.
+        while (!worklist.empty()) {
+            const size_t index = worklist.back();
+            worklist.pop_back();
+
+            const size_t first = contents.size();
+            DecodeTile(mapped_snapshot_->GetTileBlock(index), mapped_snapshot_->GetTile(index),
+                       mapped_snapshot_->GetStrings(), *this, positions, contents);
+
+            for (size_t i = first; i < contents.size(); ++i) {
+                for (const auto& pos : contents[i].GetReferencedCells()) {
+                    const auto referenced_tile = mapped_snapshot_->FindTile(
+                        CellStorage::TileKey(pos.row >> CellStorage::TILE_SHIFT, pos.col >> CellStorage::TILE_SHIFT));
+                    if (referenced_tile) {
+                        enqueue(*referenced_tile);
+                    }
+                }
+                for (const auto& range : contents[i].GetReferencedRanges()) {
+                    for (int tile_row = range.first.row >> CellStorage::TILE_SHIFT;
+                         tile_row <= range.last.row >> CellStorage::TILE_SHIFT; ++tile_row) {
+                        for (int tile_col = range.first.col >> CellStorage::TILE_SHIFT;
+                             tile_col <= range.last.col >> CellStorage::TILE_SHIFT; ++tile_col) {
+                            if (const auto tile = mapped_snapshot_->FindTile(CellStorage::TileKey(tile_row, tile_col))) {
+                                enqueue(*tile);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Область печати уже учитывает все ячейки снимка
+        ApplyContents(positions, std::move(contents), false);
+    } catch (...) {
+        for (size_t index : marked) {
+            mapped_snapshot_->SetLoaded(index, false);
+        }
+        throw;
+    }
+
+    // Все ячейки перенесены, файл больше не нужен
+    if (mapped_snapshot_->AllLoaded()) {
+        mapped_snapshot_.reset();
+    }
+}
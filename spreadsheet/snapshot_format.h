@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Исключение, выбрасываемое при чтении повреждённого или несовместимого снимка
+class SnapshotException : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Бинарный снимок листа. Все числа записываются в little-endian.
+//
+// Заголовок, HEADER_SIZE байт:
+//   char[4] magic, uint32 version, uint32 tile_count, uint32 print_area_size,
+//   uint64 strings_offset, uint64 strings_size, uint64 strings_checksum,
+//   uint64 body_checksum, uint64 header_checksum
+// Каталог: tile_count записей по TILE_ENTRY_SIZE байт, отсортированных по ключу
+//   uint32 tile_key, uint32 cell_count, uint64 offset, uint64 size, uint64 checksum
+// Область печати: print_area_size записей uint8 axis (0 - строка, 1 - столбец),
+//   uint32 index, uint32 count - число непустых ячеек в строке/столбце;
+//   по ней размер печатной области известен без чтения тайлов
+// Блоки тайлов: записи ячеек по возрастанию смещения внутри тайла
+//   uint16 local_offset, uint8 kind, uint64 text_offset, uint32 text_size,
+//   для формулы ещё uint32 formula_size и дерево формулы в постфиксной записи
+// Таблица строк: тексты ячеек без разделителей, одинаковые тексты хранятся один раз
+//
+// body_checksum покрывает каталог и область печати, header_checksum -
+// заголовок до этого поля. Сумма тайла покрывает его блок и следом тексты
+// его записей в порядке записей, поэтому тайл можно читать и проверять
+// независимо от остальных тайлов и остальной таблицы строк.
+namespace snapshot {
+
+inline constexpr char MAGIC[4] = {'S', 'P', 'S', 'N'};
+inline constexpr std::uint32_t VERSION = 2;
+inline constexpr size_t HEADER_SIZE = 4 + 4 * 3 + 8 * 5;
+inline constexpr size_t TILE_ENTRY_SIZE = 4 * 2 + 8 * 3;
+inline constexpr size_t PRINT_AREA_ENTRY_SIZE = 1 + 4 * 2;
+
+enum class CellKind : std::uint8_t {
+    Text = 1,
+    Formula = 2,
+};
+
+// FNV-1a. Сумма нескольких участков подряд считается передачей
+// предыдущей суммы в hash.
+inline std::uint64_t Checksum(std::string_view data, std::uint64_t hash = 14695981039346656037ull) {
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class Writer {
+public:
+    explicit Writer(std::string& out)
+        : out_(out) {
+    }
+
+    void PutU8(std::uint8_t value) {
+        out_.push_back(static_cast<char>(value));
+    }
+
+    void PutU16(std::uint16_t value) {
+        PutUnsigned(value, 2);
+    }
+
+    void PutU32(std::uint32_t value) {
+        PutUnsigned(value, 4);
+    }
+
+    void PutU64(std::uint64_t value) {
+        PutUnsigned(value, 8);
+    }
+
+    void PutDouble(double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        PutU64(bits);
+    }
+
+    void PutBytes(std::string_view bytes) {
+        out_.append(bytes);
+    }
+
+private:
+    std::string& out_;
+
+    void PutUnsigned(std::uint64_t value, int size) {
+        for (int i = 0; i < size; ++i) {
+            out_.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : data_(data) {
+    }
+
+    std::uint8_t GetU8() {
+        return static_cast<std::uint8_t>(GetUnsigned(1));
+    }
+
+    std::uint16_t GetU16() {
+        return static_cast<std::uint16_t>(GetUnsigned(2));
+    }
+
+    std::uint32_t GetU32() {
+        return static_cast<std::uint32_t>(GetUnsigned(4));
+    }
+
+    std::uint64_t GetU64() {
+        return GetUnsigned(8);
+    }
+
+    double GetDouble() {
+        const std::uint64_t bits = GetU64();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string_view GetBytes(size_t size) {
+        Require(size);
+        const auto bytes = data_.substr(offset_, size);
+        offset_ += size;
+        return bytes;
+    }
+
+    bool AtEnd() const {
+        return offset_ == data_.size();
+    }
+
+private:
+    std::string_view data_;
+    size_t offset_ = 0;
+
+    void Require(size_t size) const {
+        if (data_.size() - offset_ < size) {
+            throw SnapshotException("Unexpected end of snapshot data");
+        }
+    }
+
+    std::uint64_t GetUnsigned(int size) {
+        Require(size);
+        std::uint64_t value = 0;
+        for (int i = 0; i < size; ++i) {
+            value |= std::uint64_t{static_cast<unsigned char>(data_[offset_ + i])} << (8 * i);
+        }
+        offset_ += size;
+        return value;
+    }
+};
+
+struct Header {
+    std::uint32_t tile_count = 0;
+    std::uint32_t print_area_size = 0;
+    std::uint64_t strings_offset = 0;
+    std::uint64_t strings_size = 0;
+    std::uint64_t strings_checksum = 0;
+    std::uint64_t body_checksum = 0;
+};
+
+struct TileEntry {
+    std::uint32_t key = 0;
+    std::uint32_t cell_count = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint64_t checksum = 0;
+};
+
+// Участок data, бросает SnapshotException, если он выходит за границы
+inline std::string_view Slice(std::string_view data, std::uint64_t offset, std::uint64_t size) {
+    if (offset > data.size() || size > data.size() - offset) {
+        throw SnapshotException("Snapshot section is out of bounds");
+    }
+    return data.substr(offset, size);
+}
+
+// Читает и проверяет заголовок снимка data
+inline Header ReadHeader(std::string_view data) {
+    Reader in(Slice(data, 0, HEADER_SIZE));
+    if (in.GetBytes(sizeof(MAGIC)) != std::string_view(MAGIC, sizeof(MAGIC))) {
+        throw SnapshotException("Not a sheet snapshot");
+    }
+    if (in.GetU32() != VERSION) {
+        throw SnapshotException("Unsupported snapshot version");
+    }
+
+    Header header;
+    header.tile_count = in.GetU32();
+    header.print_area_size = in.GetU32();
+    header.strings_offset = in.GetU64();
+    header.strings_size = in.GetU64();
+    header.strings_checksum = in.GetU64();
+    header.body_checksum = in.GetU64();
+    if (in.GetU64() != Checksum(data.substr(0, HEADER_SIZE - 8))) {
+        throw SnapshotException("Snapshot header checksum mismatch");
+    }
+
+    return header;
+}
+
+// Каталог и область печати, следующие за заголовком
+inline std::string_view ReadBody(std::string_view data, const Header& header) {
+    const std::string_view body = Slice(data, HEADER_SIZE,
+                                        std::uint64_t{header.tile_count} * TILE_ENTRY_SIZE
+                                        + std::uint64_t{header.print_area_size} * PRINT_AREA_ENTRY_SIZE);
+    if (Checksum(body) != header.body_checksum) {
+        throw SnapshotException("Snapshot directory checksum mismatch");
+    }
+    return body;
+}
+
+inline TileEntry ReadTileEntry(Reader& in) {
+    TileEntry tile;
+    tile.key = in.GetU32();
+    tile.cell_count = in.GetU32();
+    tile.offset = in.GetU64();
+    tile.size = in.GetU64();
+    tile.checksum = in.GetU64();
+    return tile;
+}
+
+// Блок тайла tile в снимке data, проверенный вместе с текстами своих ячеек
+// из таблицы строк strings. Записи до проверки читаются только с контролем
+// границ.
+inline std::string_view ReadTileBlock(std::string_view data, const TileEntry& tile, std::string_view strings) {
+    const std::string_view block = Slice(data, tile.offset, tile.size);
+    std::uint64_t checksum = Checksum(block);
+
+    Reader cells(block);
+    while (!cells.AtEnd()) {
+        cells.GetU16();
+        const auto kind = static_cast<CellKind>(cells.GetU8());
+        const std::uint64_t text_offset = cells.GetU64();
+        checksum = Checksum(Slice(strings, text_offset, cells.GetU32()), checksum);
+        if (kind == CellKind::Formula) {
+            cells.GetBytes(cells.GetU32());
+        }
+    }
+
+    if (checksum != tile.checksum) {
+        throw SnapshotException("Snapshot tile checksum mismatch");
+    }
+    return block;
+}
+
+}  // namespace snapshot
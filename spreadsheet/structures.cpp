@@ -78,4 +78,42 @@ Position Position::FromString(std::string_view str) {
 
 bool Size::operator==(Size rhs) const {
     return cols == rhs.cols && rows == rhs.rows;
-}
\ No newline at end of file
+}
+
+bool Range::operator==(Range rhs) const {
+    return first == rhs.first && last == rhs.last;
+}
+
+bool Range::IsValid() const {
+    return first.IsValid() && last.IsValid() && first.row <= last.row && first.col <= last.col;
+}
+
+bool Range::Contains(Position pos) const {
+    return pos.row >= first.row && pos.row <= last.row && pos.col >= first.col && pos.col <= last.col;
+}
+
+Size Range::GetSize() const {
+    return {last.row - first.row + 1, last.col - first.col + 1};
+}
+
+std::string Range::ToString() const {
+    if (!IsValid()) {
+        return "";
+    }
+
+    return first.ToString() + ':' + last.ToString();
+}
+
+Range Range::FromString(std::string_view str) {
+    const auto colon = str.find(':');
+    if (colon == str.npos) {
+        return {Position::NONE, Position::NONE};
+    }
+
+    const Range range{Position::FromString(str.substr(0, colon)), Position::FromString(str.substr(colon + 1))};
+    if (!range.IsValid()) {
+        return {Position::NONE, Position::NONE};
+    }
+
+    return range;
+}
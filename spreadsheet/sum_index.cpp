@@ -0,0 +1,106 @@
+#include "sum_index.h"
+
+#include <cmath>
+
+namespace {
+void AddTotals(SumIndex::Totals& lhs, const SumIndex::Totals& rhs, int sign = 1) {
+    lhs.sum += sign * rhs.sum;
+    lhs.magnitude += sign * rhs.magnitude;
+    lhs.count += sign * rhs.count;
+    lhs.inexact += sign * rhs.inexact;
+    lhs.formulas += sign * rhs.formulas;
+}
+}  // namespace
+
+SumIndex::Totals SumIndex::FromNumber(double value) {
+    Totals totals;
+    totals.count = 1;
+    // NaN не проходит ни одно сравнение и тоже попадает в inexact
+    if (std::abs(value) <= MAX_EXACT_VALUE && value == std::trunc(value)) {
+        totals.sum = static_cast<std::int64_t>(value);
+        totals.magnitude = std::abs(totals.sum);
+    } else {
+        totals.inexact = 1;
+    }
+    return totals;
+}
+
+SumIndex::SumIndex(Range region)
+    : region_(region)
+    , rows_(region.last.row - region.first.row + 1)
+    , cols_(region.last.col - region.first.col + 1)
+    , nodes_(static_cast<size_t>(rows_) * cols_) {
+}
+
+Range SumIndex::GetRegion() const {
+    return region_;
+}
+
+void SumIndex::Update(Position pos, const Totals& before, const Totals& after) {
+    if (!region_.Contains(pos)) {
+        return;
+    }
+
+    Totals delta = after;
+    AddTotals(delta, before, -1);
+
+    // Узел i отвечает за позиции (i & (i + 1)) .. i
+    for (int row = pos.row - region_.first.row; row < rows_; row |= row + 1) {
+        for (int col = pos.col - region_.first.col; col < cols_; col |= col + 1) {
+            AddTotals(Node(row, col), delta);
+        }
+    }
+}
+
+SumIndex::Totals SumIndex::Query(Range range) const {
+    const int first_row = range.first.row - region_.first.row;
+    const int first_col = range.first.col - region_.first.col;
+    const int last_row = range.last.row - region_.first.row;
+    const int last_col = range.last.col - region_.first.col;
+
+    Totals result = Prefix(last_row, last_col);
+    AddTotals(result, Prefix(first_row - 1, last_col), -1);
+    AddTotals(result, Prefix(last_row, first_col - 1), -1);
+    AddTotals(result, Prefix(first_row - 1, first_col - 1));
+    return result;
+}
+
+void SumIndex::Put(Position pos, const Totals& totals) {
+    if (region_.Contains(pos)) {
+        Node(pos.row - region_.first.row, pos.col - region_.first.col) = totals;
+    }
+}
+
+void SumIndex::Build() {
+    // Измерения независимы: сначала каждая строка становится деревом по
+    // столбцам, затем каждый столбец - деревом по строкам
+    for (int row = 0; row < rows_; ++row) {
+        for (int col = 0; col < cols_; ++col) {
+            if (const int parent = col | (col + 1); parent < cols_) {
+                AddTotals(Node(row, parent), Node(row, col));
+            }
+        }
+    }
+    for (int row = 0; row < rows_; ++row) {
+        if (const int parent = row | (row + 1); parent < rows_) {
+            for (int col = 0; col < cols_; ++col) {
+                AddTotals(Node(parent, col), Node(row, col));
+            }
+        }
+    }
+}
+
+SumIndex::Totals& SumIndex::Node(int row, int col) {
+    return nodes_[static_cast<size_t>(row) * cols_ + col];
+}
+
+SumIndex::Totals SumIndex::Prefix(int row, int col) const {
+    Totals result;
+    for (; row >= 0; row = (row & (row + 1)) - 1) {
+        const Totals* line = &nodes_[static_cast<size_t>(row) * cols_];
+        for (int i = col; i >= 0; i = (i & (i + 1)) - 1) {
+            AddTotals(result, line[i]);
+        }
+    }
+    return result;
+}
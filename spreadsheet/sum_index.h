@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+// Двумерное дерево Фенвика над областью листа. По прямоугольнику внутри
+// области за O(log rows * log cols) возвращает сумму чисел, их количество и
+// число формул; изменение одной ячейки стоит столько же. Память - по узлу
+// Totals на каждую позицию области, поэтому индекс строится над областью,
+// которую задаёт пользователь, а не над всем листом.
+//
+// Сумма перебором складывает double по порядку и округляет каждую
+// частичную сумму, а индекс собирает ответ из префиксов в другом порядке.
+// Совпасть бит в бит они могут, только если округлений нет вовсе, поэтому
+// индекс складывает точно лишь целые числа не больше MAX_EXACT_VALUE по
+// модулю, в int64, и для каждого прямоугольника знает сумму их модулей.
+// Когда все числа прямоугольника такие и сумма модулей не больше
+// MAX_EXACT_MAGNITUDE, любая частичная сумма в любом порядке представима в
+// double точно и совпадает с суммой перебора. Остальные числа только
+// считаются в inexact.
+class SumIndex {
+public:
+    struct Totals {
+        std::int64_t sum = 0;
+        // Сумма модулей
+        std::int64_t magnitude = 0;
+        std::int32_t count = 0;
+        // Числа, которые индекс не складывает: дробные, бесконечные или
+        // больше MAX_EXACT_VALUE по модулю
+        std::int32_t inexact = 0;
+        std::int32_t formulas = 0;
+    };
+
+    // Позиций на листе меньше 2^28, поэтому с таким пределом суммы узлов не
+    // переполняют int64
+    static constexpr double MAX_EXACT_VALUE = 0x1p32;
+    // Целые до 2^53 по модулю представимы в double точно
+    static constexpr std::int64_t MAX_EXACT_MAGNITUDE = std::int64_t{1} << 53;
+
+    // Итоги позиции с числом value
+    static Totals FromNumber(double value);
+
+    explicit SumIndex(Range region);
+
+    Range GetRegion() const;
+
+    // Заменяет итоги позиции pos before на after; позиции вне области
+    // пропускаются
+    void Update(Position pos, const Totals& before, const Totals& after);
+    // Итоги прямоугольника range, который должен лежать внутри области
+    Totals Query(Range range) const;
+
+    // Строит дерево за O(rows * cols) после того, как значения позиций
+    // записаны через Put
+    void Put(Position pos, const Totals& totals);
+    void Build();
+
+private:
+    Range region_;
+    int rows_;
+    int cols_;
+    std::vector<Totals> nodes_;
+
+    Totals& Node(int row, int col);
+    // Итоги позиций [0, row] x [0, col] в координатах области; отрицательная
+    // граница даёт пустой прямоугольник
+    Totals Prefix(int row, int col) const;
+};